@@ -0,0 +1,225 @@
+/**
+ * @file cor_bench.c
+ * @brief Host benchmarks of the scheduler hot paths.
+ * @note Build: cc -O2 -o cor_bench cor_bench.c
+ *       Usage:  cor_bench [iterations] > result.jsonl
+ *       The kernel source is included directly so the dispatcher and the sleep queue can be timed on their own.
+ *       Each result is one JSON object per line: bench, n (tasks besides idle), k (tasks involved), iters, ns_per_op.
+ */
+
+#ifndef COROUTINE_MAX_SIZE
+#define COROUTINE_MAX_SIZE 256
+#endif
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "../coroutine.c"
+
+static const cor_id_t bench_n[] = {1, 8, 31, 127, 255};
+static uint32_t bench_iters = 200000;
+static uint32_t bench_now;
+static volatile uint32_t bench_count;
+static cor_mutex_t bench_lock = COR_MUTEX_INIT;
+
+static uint32_t bench_tick(void)
+{
+    return bench_now;
+}
+
+static uint64_t bench_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_report(const char *name, cor_id_t n, cor_id_t k, uint32_t iters, uint64_t ns)
+{
+    printf("{\"bench\":\"%s\",\"n\":%u,\"k\":%u,\"iters\":%u,\"ns_per_op\":%.2f}\n",
+           name, (unsigned)n, (unsigned)k, (unsigned)iters, iters ? (double)ns / iters : 0.0);
+}
+
+/**
+ * @brief Fresh kernel with n tasks running callback, all ready as after the start of cor_run.
+ */
+static void bench_setup(cor_id_t n, void (*callback)(void *arg))
+{
+    cor_handle_t handle;
+    cor_deinit();
+    bench_now = 0;
+    cor_init(n, bench_tick);
+    for (cor_id_t i = 0; i < n; i++)
+    {
+        cor_create_task(&handle, callback, NULL);
+    }
+    for (cor_id_t i = 1; i < param.cap; i++)
+    {
+        cor_set_state(i, COR_READY);
+    }
+    param.bits.started = 1;
+}
+
+static void bench_yield_task(void *arg)
+{
+    COR_BEGIN();
+    for (;;)
+    {
+        bench_count++;
+        cor_yield();
+    }
+}
+
+static void bench_sleep_task(void *arg)
+{
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_sleep(1);
+    }
+}
+
+static void bench_mutex_task(void *arg)
+{
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_mutex_lock(&bench_lock);
+        bench_count++;
+        cor_yield();
+        cor_mutex_unlock(&bench_lock);
+    }
+}
+
+/* One dispatch plus one task run to its next cor_yield */
+static void bench_yield(cor_id_t n)
+{
+    uint64_t start;
+    bench_setup(n, bench_yield_task);
+    start = bench_ns();
+    for (uint32_t i = 0; i < bench_iters; i++)
+    {
+        cor_dispatch();
+        cor_exec();
+    }
+    bench_report("yield_round_trip", n, n, bench_iters, bench_ns() - start);
+}
+
+/* Two back to back bench_ns calls, taken off the per-call timings below */
+static uint64_t bench_ns_overhead(void)
+{
+    uint64_t start;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < bench_iters; i++)
+    {
+        start = bench_ns();
+        total += bench_ns() - start;
+    }
+    return total;
+}
+
+/* Put the dispatched task back into its ready set, as cor_exec does once a yielding task returns */
+static void bench_requeue(void)
+{
+#if COR_NUM_CORES > 1
+    param.coroutine[COR_CURRID].bits.oncpu = 0;
+#endif
+    if (COR_CURRID != 0)
+    {
+        cor_set_state(COR_CURRID, COR_READY);
+    }
+}
+
+/* Picking the next task with k of the n tasks ready, the others suspended */
+static void bench_dispatch(cor_id_t n, cor_id_t k)
+{
+    uint64_t start;
+    uint64_t spent = 0;
+    uint64_t overhead;
+    bench_setup(n, bench_yield_task);
+    for (cor_id_t i = k + 1; i < param.cap; i++)
+    {
+        cor_handle_t handle = COR_HANDLE(i);
+        suspend(&handle);
+    }
+    overhead = bench_ns_overhead();
+    // Only the pick is timed, the requeue keeps k tasks ready for the next one
+    for (uint32_t i = 0; i < bench_iters; i++)
+    {
+        start = bench_ns();
+        cor_dispatch();
+        spent += bench_ns() - start;
+        assert_param(COR_CURRID != 0);
+        bench_requeue();
+    }
+    bench_report("dispatch", n, k, bench_iters, spent > overhead ? spent - overhead : 0);
+}
+
+/* Timer processing: k sleepers due at once, then the same queue with none due */
+static void bench_timer(cor_id_t n)
+{
+    uint32_t rounds = bench_iters / n + 1;
+    uint64_t due = 0;
+    uint64_t idle = 0;
+    uint64_t start;
+    bench_setup(n, bench_sleep_task);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        // Every task runs into cor_sleep(1), all of them are due one tick later
+        for (cor_id_t i = 1; i < param.cap; i++)
+        {
+            COR_CURRID = i;
+            cor_exec();
+        }
+        start = bench_ns();
+        cor_process_time();
+        idle += bench_ns() - start;
+        bench_now += 1;
+        start = bench_ns();
+        cor_process_time();
+        due += bench_ns() - start;
+    }
+    bench_report("timer_wake", n, n, rounds * n, due);
+    bench_report("timer_none_due", n, n, rounds, idle);
+}
+
+/* Two tasks handing one mutex back and forth, the unlock passes it straight to the waiter */
+static void bench_mutex(void)
+{
+    uint64_t start;
+    bench_setup(2, bench_mutex_task);
+    bench_count = 0;
+    start = bench_ns();
+    for (uint32_t i = 0; i < bench_iters; i++)
+    {
+        cor_dispatch();
+        cor_exec();
+    }
+    bench_report("mutex_handoff", 2, 2, bench_count, bench_ns() - start);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        bench_iters = (uint32_t)strtoul(argv[1], NULL, 0);
+    }
+    if (bench_iters == 0)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+    for (size_t i = 0; i < sizeof(bench_n) / sizeof(bench_n[0]); i++)
+    {
+        cor_id_t n = bench_n[i];
+        if (n > COROUTINE_MAX_SIZE - 1)
+        {
+            continue;
+        }
+        bench_yield(n);
+        bench_dispatch(n, 1);
+        bench_dispatch(n, n);
+        bench_timer(n);
+    }
+    bench_mutex();
+    cor_deinit();
+    return 0;
+}
@@ -40,250 +40,3281 @@
 */
 
 #include "coroutine.h"
+#if COR_USE_EPOLL
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
-#define COROUTINE_MAX_SIZE (32)
-cor_handle_t CorIdleHandle = 0;
-struct
+/*
+ * Compiler primitives, each one overridable. GCC and clang, armclang included, use their
+ * builtins. Other compilers (IAR, Keil ARMCC 5) get plain C bit scans and, on a single
+ * bare metal core, the CMSIS intrinsics of the board header: the atomics mask interrupts
+ * around the access and the fences are __DMB(). Hosted or multi-core builds with such a
+ * compiler define COR_ATOMIC_OR, COR_ATOMIC_XCHG, COR_ATOMIC_LOAD, COR_ATOMIC_STORE,
+ * COR_ATOMIC_CAS and COR_FENCE themselves.
+ */
+#ifndef COR_CTZ
+#if defined(__GNUC__)
+#define COR_CTZ(x) ((uint32_t)__builtin_ctz(x))
+#else
+/* Index of the lowest set bit, x must not be 0 */
+static inline uint32_t cor_ctz(uint32_t x)
+{
+    uint32_t n = 0;
+    for (uint32_t shift = 16; shift != 0; shift /= 2)
+    {
+        if ((x & ((1u << shift) - 1)) == 0)
+        {
+            n += shift;
+            x >>= shift;
+        }
+    }
+    return n;
+}
+#define COR_CTZ(x) cor_ctz(x)
+#endif
+#endif
+#ifndef COR_CLZ
+#if defined(__GNUC__)
+#define COR_CLZ(x) ((uint32_t)__builtin_clz(x))
+#else
+/* Zero bits above the highest set bit, x must not be 0 */
+static inline uint32_t cor_clz(uint32_t x)
+{
+    uint32_t n = 0;
+    for (uint32_t shift = 16; shift != 0; shift /= 2)
+    {
+        if ((x >> (32 - shift)) == 0)
+        {
+            n += shift;
+            x <<= shift;
+        }
+    }
+    return n;
+}
+#define COR_CLZ(x) cor_clz(x)
+#endif
+#endif
+#ifndef COR_WEAK
+#if defined(__GNUC__)
+#define COR_WEAK __attribute__((weak))
+#elif defined(__ICCARM__) || defined(__CC_ARM)
+#define COR_WEAK __weak
+#else
+/* No weak symbols: the default callbacks below cannot be replaced by the application */
+#define COR_WEAK
+#endif
+#endif
+/* Placed in front of a declaration */
+#ifndef COR_ALIGNED
+#if defined(__GNUC__)
+#define COR_ALIGNED(n) __attribute__((aligned(n)))
+#elif defined(__CC_ARM)
+#define COR_ALIGNED(n) __align(n)
+#elif defined(__cplusplus)
+#define COR_ALIGNED(n) alignas(n)
+#else
+#define COR_ALIGNED(n) _Alignas(n)
+#endif
+#endif
+#ifndef COR_ALIGNOF
+#if defined(__GNUC__) || defined(__CC_ARM)
+#define COR_ALIGNOF(type) __alignof__(type)
+#elif defined(__cplusplus)
+#define COR_ALIGNOF(type) alignof(type)
+#else
+#define COR_ALIGNOF(type) _Alignof(type)
+#endif
+#endif
+#if defined(__GNUC__)
+#ifndef COR_ATOMIC_OR
+#define COR_ATOMIC_OR(ptr, val) __atomic_fetch_or((ptr), (val), __ATOMIC_RELEASE)
+#endif
+#ifndef COR_ATOMIC_XCHG
+#define COR_ATOMIC_XCHG(ptr, val) __atomic_exchange_n((ptr), (val), __ATOMIC_ACQUIRE)
+#endif
+#ifndef COR_ATOMIC_LOAD
+#define COR_ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#endif
+#ifndef COR_ATOMIC_STORE
+#define COR_ATOMIC_STORE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#endif
+/* Weak compare and swap of a pointer, release on success */
+#ifndef COR_ATOMIC_CAS
+#define COR_ATOMIC_CAS(ptr, expected, desired) \
+    __atomic_compare_exchange_n((ptr), (expected), (desired), true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#endif
+#ifndef COR_FENCE
+#define COR_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+#elif !defined(COR_ATOMIC_OR) || !defined(COR_ATOMIC_XCHG) || !defined(COR_ATOMIC_LOAD) || \
+    !defined(COR_ATOMIC_STORE) || !defined(COR_ATOMIC_CAS) || !defined(COR_FENCE)
+#if COR_HOSTED || COR_NUM_CORES > 1
+#error "Define COR_ATOMIC_OR, COR_ATOMIC_XCHG, COR_ATOMIC_LOAD, COR_ATOMIC_STORE, COR_ATOMIC_CAS and COR_FENCE for this compiler"
+#endif
+static inline void cor_atomic_or_masked(volatile uint32_t *ptr, uint32_t val)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *ptr |= val;
+    __set_PRIMASK(primask);
+}
+static inline uintptr_t cor_atomic_xchg_masked(volatile void *ptr, uintptr_t val, size_t size)
+{
+    uint32_t primask = __get_PRIMASK();
+    uintptr_t old;
+    __disable_irq();
+    if (size == 1)
+    {
+        old = *(volatile uint8_t *)ptr;
+        *(volatile uint8_t *)ptr = (uint8_t)val;
+    }
+    else if (size == 2)
+    {
+        old = *(volatile uint16_t *)ptr;
+        *(volatile uint16_t *)ptr = (uint16_t)val;
+    }
+    else
+    {
+        old = *(volatile uintptr_t *)ptr;
+        *(volatile uintptr_t *)ptr = val;
+    }
+    __set_PRIMASK(primask);
+    return old;
+}
+static inline uint32_t cor_atomic_load_acquire(const volatile uint32_t *ptr)
+{
+    uint32_t val = *ptr;
+    __DMB();
+    return val;
+}
+static inline bool cor_atomic_cas_masked(void *volatile *ptr, void **expected, void *desired)
+{
+    uint32_t primask = __get_PRIMASK();
+    bool ok;
+    __disable_irq();
+    ok = *ptr == *expected;
+    if (ok)
+    {
+        *ptr = desired;
+    }
+    else
+    {
+        *expected = *ptr;
+    }
+    __set_PRIMASK(primask);
+    return ok;
+}
+#ifndef COR_ATOMIC_OR
+#define COR_ATOMIC_OR(ptr, val) cor_atomic_or_masked((ptr), (val))
+#endif
+#ifndef COR_ATOMIC_XCHG
+#define COR_ATOMIC_XCHG(ptr, val) cor_atomic_xchg_masked((ptr), (uintptr_t)(val), sizeof(*(ptr)))
+#endif
+#ifndef COR_ATOMIC_LOAD
+#define COR_ATOMIC_LOAD(ptr) cor_atomic_load_acquire(ptr)
+#endif
+#ifndef COR_ATOMIC_STORE
+#define COR_ATOMIC_STORE(ptr, val) \
+    do                             \
+    {                              \
+        __DMB();                   \
+        *(ptr) = (val);            \
+    } while (0)
+#endif
+#ifndef COR_ATOMIC_CAS
+#define COR_ATOMIC_CAS(ptr, expected, desired) \
+    cor_atomic_cas_masked((void *volatile *)(ptr), (void **)(expected), (void *)(desired))
+#endif
+#ifndef COR_FENCE
+#define COR_FENCE() __DMB()
+#endif
+#endif
+#if (COR_ENABLE_STATS || COR_ENABLE_WATCHDOG) && !defined(COR_CYCLES)
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define COR_CYCLES() (DWT->CYCCNT)
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define COR_CYCLES() ((uint32_t)__rdtsc())
+#else
+#include <time.h>
+static inline uint32_t cor_cycles(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+#define COR_CYCLES() cor_cycles()
+#endif
+#endif
+
+#define COR_BITMAP_WORDS ((COROUTINE_MAX_SIZE + 31) / 32)
+#define COR_SUMMARY_WORDS ((COR_BITMAP_WORDS + 31) / 32)
+/**
+ * @brief Two level bitmap, one bit per task plus one summary bit per non-empty word.
+ */
+typedef struct
+{
+    uint32_t word[COR_BITMAP_WORDS];
+    uint32_t summary[COR_SUMMARY_WORDS];
+} cor_bitmap_t;
+
+/**
+ * @brief Scheduler state private to one core.
+ */
+typedef struct
+{
+    cor_bitmap_t ready[COR_PRIO_LEVELS]; /* Per level, bit n is set while task n is COR_READY */
+    uint32_t readyprio;                  /* Bit p is set while level p has a ready task */
+    cor_id_t last[COR_PRIO_LEVELS];      /* Last task dispatched per level, for round robin */
+    cor_id_t currid;
+#if COR_ENABLE_STACKFUL
+    void *schedsp; /* Stack pointer of the scheduler while a stackful task runs */
+#endif
+} cor_core_t;
+
+#if COR_ENABLE_STACKFUL
+#define COR_STACK_GUARD 0x4B435453u /* "STCK", lowest word of every stack, checked after each run */
+#define COR_STACK_PAINT 0xA5u       /* Fill of the unused part of a stack, for cor_stack_high_water */
+/**
+ * @brief Header of a stack block carved from the pool.
+ */
+typedef struct cor_stack_block
+{
+    struct cor_stack_block *next; /* Next block given back by a deleted task */
+    uint32_t size;                /* Bytes of the block, header included */
+} cor_stack_block_t;
+#define COR_STACK_HEADER ((sizeof(cor_stack_block_t) + 15u) & ~15u)
+#endif
+
+#if COR_POOL_SIZE > 0
+/**
+ * @brief Header of a pool block, the caller's bytes follow it.
+ */
+typedef struct cor_pool_block
+{
+    struct cor_pool_block *next; /* Next block of the same freelist while free */
+#if COR_ENABLE_INSTANCES
+    struct cor_sched *sched; /* Instance whose pool the block was carved from */
+#endif
+    uint8_t cls;  /* Size class, the block holds 16 << cls bytes */
+    uint8_t core; /* Core whose pool the block was carved from */
+} cor_pool_block_t;
+#define COR_POOL_ALIGN (2 * sizeof(void *))
+#define COR_POOL_HEADER ((sizeof(cor_pool_block_t) + COR_POOL_ALIGN - 1) & ~(COR_POOL_ALIGN - 1))
+/**
+ * @brief Block pool of one core.
+ */
+typedef struct
+{
+    COR_ALIGNED(16) uint8_t mem[COR_POOL_SIZE];
+    uint32_t used;                            /* Bytes carved from the start of mem */
+    cor_pool_block_t *free[COR_POOL_CLASSES]; /* Freed blocks per size class */
+    cor_pool_block_t *volatile remote;        /* Blocks freed by other cores or instances, pushed lock free */
+} cor_pool_t;
+#endif
+
+#if !COR_ENABLE_WATCHDOG && !COR_ENABLE_STATS && !COR_ENABLE_STACKFUL && COROUTINE_MAX_SIZE <= 0xFF
+/* The task table entry stays at three pointers and its small fields, per-task state of
+   optional or blocking paths lives in the arrays of struct cor_sched instead */
+COR_STATIC_ASSERT(sizeof(Coroutine_t) <= 4 * sizeof(void *), "Coroutine_t grew past its default size");
+#endif
+
+struct cor_sched
+{
+    Coroutine_t *coroutine;
+#if !COR_USE_MALLOC
+    Coroutine_t table[COROUTINE_MAX_SIZE]; /* Task table of cor_init, one per instance */
+#endif
+    cor_handle_t idle; /* Handle of the idle task */
+    uint32_t (*get_tick_1ms)(void);
+    cor_tick_t (*get_tick)(void); /* Set by cor_set_tick_source, replaces get_tick_1ms */
+    uint32_t hz;
+    cor_tick_t tick;                            /* Tick of the current dispatch */
+    struct
+    {
+        cor_tick_t timeout[COROUTINE_MAX_SIZE]; /* Absolute wake-up tick while in the sleep queue */
+        cor_id_t sleepidx[COROUTINE_MAX_SIZE];  /* Position in the sleep queue */
+        uint8_t state[COROUTINE_MAX_SIZE];      /* cor_state_t, a whole byte so updates need no read-modify-write */
+        uint8_t prio[COROUTINE_MAX_SIZE];
+        uint8_t core[COROUTINE_MAX_SIZE];       /* Core whose ready set holds the task */
+#if COR_SCHED_POLICY == COR_SCHED_EDF
+        cor_tick_t deadline[COROUTINE_MAX_SIZE]; /* Absolute deadline of the current cor_periodic job */
+#endif
+    } task; /* Per-task fields of the scheduler hot paths, kept apart from the task table */
+    struct
+    {
+        cor_waitq_t *queue[COROUTINE_MAX_SIZE]; /* Wait queue the task is blocked on */
+        uint32_t arg[COROUTINE_MAX_SIZE];       /* Event mask while blocked, wait result once woken */
+        void *msg[COROUTINE_MAX_SIZE];          /* Channel message being passed to or from the task */
+    } wait; /* Per-task wait state, only touched by blocking calls and their wakers */
+    struct
+    {
+        cor_tick_t release[COROUTINE_MAX_SIZE]; /* Next release of a cor_periodic loop */
+        uint16_t overruns[COROUTINE_MAX_SIZE];  /* Periodic releases missed, saturates */
+    } job; /* Per-task state of cor_periodic loops */
+    struct
+    {
+        cor_id_t id[COROUTINE_MAX_SIZE];
+        cor_id_t count;
+    } sleep; /* Binary min-heap of waiting tasks, keyed by wake-up tick */
+    cor_core_t core[COR_NUM_CORES];
+    volatile uint8_t wakeup; /* Set by cor_wakeup, cleared on every dispatch */
+    volatile uint32_t notify[COR_BITMAP_WORDS];     /* Notifications posted from interrupts */
+    volatile uint32_t notifysum[COR_SUMMARY_WORDS]; /* Bit w is set once word w has a notification */
+    cor_id_t cap;
+    cor_id_t created;  /* Slots handed out by cor_create_task so far */
+    cor_id_t freelist; /* First slot freed by cor_delete_task, linked through next, 0 if none */
+#if COR_USE_EPOLL
+    int epfd;           /* Created on the first cor_await_fd, -1 before */
+    int evfd;           /* Eventfd that ends an idle epoll_wait on cor_wakeup */
+    cor_id_t iowaiters; /* Tasks waiting on a file descriptor */
+#endif
+#if COR_ENABLE_STACKFUL
+    struct
+    {
+        COR_ALIGNED(16) uint8_t pool[COR_STACK_POOL_SIZE];
+        uint32_t used;           /* Bytes carved from the start of the pool */
+        cor_stack_block_t *free; /* Blocks given back, reused first fit */
+    } stack;
+#endif
+#if COR_POOL_SIZE > 0
+    cor_pool_t pool[COR_NUM_CORES];
+    uint32_t taskctx[COR_BITMAP_WORDS]; /* Bit n is set while task n owns a context from the pool */
+#endif
+#if COR_ENABLE_SIM
+    struct
+    {
+        cor_tick_t now; /* Virtual clock */
+        uint32_t rand;  /* State of cor_sim_random */
+    } sim;
+#endif
+#if COR_TRACE_SIZE > 0
+    struct
+    {
+        cor_trace_event_t event[COR_TRACE_SIZE];
+        uint32_t head; /* Events ever recorded, the ring index is its low bits */
+    } trace;
+#endif
+#if COR_NUM_CORES > 1
+    volatile uint32_t lock;     /* Kernel spinlock shared by all cores */
+    volatile uint8_t lockowner; /* Core id + 1 of the holder, the lock is recursive */
+    uint8_t lockdepth;
+#endif
+    struct
+    {
+        uint8_t alreadyInit : 1;
+        uint8_t ownTable : 1; /* The table was allocated by cor_init */
+        uint8_t started : 1;  /* The first cor_run has readied the tasks */
+        uint8_t sim : 1;      /* The tick is the virtual clock of cor_sim_start */
+        uint8_t ownSched : 1; /* The instance was allocated by cor_sched_create */
+    } bits;
+};
+#if COR_ENABLE_INSTANCES
+static struct cor_sched cor_sched_default;
+#if COR_NUM_CORES > 1 && !COR_HOSTED
+/* No threads on bare metal, each core keeps its own selection, see cor_sched_use */
+#if COR_NUM_CORES == 2
+static struct cor_sched *cor_sched_current[COR_NUM_CORES] = {&cor_sched_default, &cor_sched_default};
+#elif COR_NUM_CORES == 3
+static struct cor_sched *cor_sched_current[COR_NUM_CORES] = {&cor_sched_default, &cor_sched_default,
+                                                             &cor_sched_default};
+#elif COR_NUM_CORES == 4
+static struct cor_sched *cor_sched_current[COR_NUM_CORES] = {&cor_sched_default, &cor_sched_default,
+                                                             &cor_sched_default, &cor_sched_default};
+#else
+#error "COR_ENABLE_INSTANCES on bare metal supports up to 4 cores"
+#endif
+#define COR_SCHED_CURRENT (cor_sched_current[COR_CORE_ID()])
+#else
+/* Scheduler the calling thread works on, see cor_sched_use */
+static COR_THREAD_LOCAL struct cor_sched *cor_sched_current = &cor_sched_default;
+#define COR_SCHED_CURRENT cor_sched_current
+#endif
+#define param (*COR_SCHED_CURRENT)
+#else
+struct cor_sched param;
+#endif
+/* Task running on the calling core */
+#define COR_CURRID (param.core[COR_CORE_ID()].currid)
+/* Handle of a task at the current generation of its slot */
+#define COR_HANDLE(id) ((cor_handle_t)param.coroutine[id].gen << COR_ID_BITS | (id))
+/* What a COR_IOWAIT task waits on, kept in bits.waitmode */
+#define COR_IO_COMPLETION 0
+#define COR_IO_FD 1
+/* What a COR_BLOCKED task without a wait queue waits on, kept in bits.waitmode */
+#define COR_NOTIFY_PLAIN 0
+#define COR_NOTIFY_SPSC 1 /* Inside cor_spsc_recv, msg holds the ring until a message lands there */
+
+#if COR_TRACE_SIZE > 0
+#ifndef COR_TRACE_TIME
+#define COR_TRACE_TIME() ((uint32_t)cor_get_tick())
+#endif
+/**
+ * @brief Record a scheduler event, called with the kernel lock held.
+ * @param event cor_trace_type_t.
+ * @param id Task id.
+ */
+static void cor_trace_record(uint8_t event, cor_id_t id)
+{
+    cor_trace_event_t *e = &param.trace.event[param.trace.head & (COR_TRACE_SIZE - 1)];
+    e->time = COR_TRACE_TIME();
+    e->task = (uint16_t)id;
+    e->event = event;
+    e->core = (uint8_t)COR_CORE_ID();
+    param.trace.head += 1;
+}
+#define COR_TRACE(event, id) cor_trace_record((event), (id))
+#else
+#define COR_TRACE(event, id) ((void)0)
+#endif
+
+#if COR_NUM_CORES > 1
+/**
+ * @brief Take the kernel lock, nests on the same core.
+ */
+static void cor_lock(void)
+{
+    uint8_t self = COR_CORE_ID() + 1;
+    if (param.lockowner == self)
+    {
+        param.lockdepth += 1;
+        return;
+    }
+    while (COR_ATOMIC_XCHG(&param.lock, 1) != 0)
+    {
+        while (param.lock != 0)
+        {
+        }
+    }
+    param.lockowner = self;
+    param.lockdepth = 1;
+}
+static void cor_unlock(void)
+{
+    param.lockdepth -= 1;
+    if (param.lockdepth == 0)
+    {
+        param.lockowner = 0;
+        COR_ATOMIC_STORE(&param.lock, 0);
+    }
+}
+#define COR_LOCK() cor_lock()
+#define COR_UNLOCK() cor_unlock()
+#else
+#define COR_LOCK()
+#define COR_UNLOCK()
+#endif
+static inline void cor_bitmap_set(cor_bitmap_t *map, uint32_t n)
+{
+    map->word[n / 32] |= 1u << (n % 32);
+    map->summary[n / 1024] |= 1u << (n / 32 % 32);
+}
+/**
+ * @brief Clear a bit.
+ * @return true if the bitmap is empty afterwards.
+ */
+static inline bool cor_bitmap_clear(cor_bitmap_t *map, uint32_t n)
+{
+    map->word[n / 32] &= ~(1u << (n % 32));
+    if (map->word[n / 32] != 0)
+    {
+        return false;
+    }
+    map->summary[n / 1024] &= ~(1u << (n / 32 % 32));
+    for (uint32_t i = 0; i < COR_SUMMARY_WORDS; i++)
+    {
+        if (map->summary[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+/**
+ * @brief Find the first set bit at or after n.
+ * @return Bit number, -1 if there is none.
+ */
+static int32_t cor_bitmap_find(const cor_bitmap_t *map, uint32_t n)
+{
+    uint32_t w = n / 32;
+    uint32_t s;
+    uint32_t bits;
+    if (w >= COR_BITMAP_WORDS)
+    {
+        return -1;
+    }
+    bits = map->word[w] & (~0u << (n % 32));
+    if (bits != 0)
+    {
+        return w * 32 + COR_CTZ(bits);
+    }
+    // Skip the empty words through the summary
+    w += 1;
+    s = w / 32;
+    if (s >= COR_SUMMARY_WORDS)
+    {
+        return -1;
+    }
+    bits = map->summary[s] & (~0u << (w % 32));
+    while (bits == 0)
+    {
+        if (++s >= COR_SUMMARY_WORDS)
+        {
+            return -1;
+        }
+        bits = map->summary[s];
+    }
+    w = s * 32 + COR_CTZ(bits);
+    return w * 32 + COR_CTZ(map->word[w]);
+}
+
+/**
+ * @brief Set the state of a task and keep the ready bitmap in step.
+ * @param id Task id.
+ * @param state New state.
+ */
+static inline void cor_set_state(cor_id_t id, cor_state_t state)
+{
+    cor_core_t *core = &param.core[param.task.core[id]];
+    uint8_t prio = param.task.prio[id];
+    param.task.state[id] = state;
+    // The idle task is never in the ready set, it only runs when the set is empty
+#if COR_NUM_CORES > 1
+    // A task still returning from its callback on some core is queued once cor_exec is done with it
+    if (state == COR_READY && id != 0 && !param.coroutine[id].bits.oncpu)
+    {
+#if COR_ENABLE_STATS
+        param.coroutine[id].readyat = COR_CYCLES();
+#endif
+        cor_bitmap_set(&core->ready[prio], id);
+        core->readyprio |= 1u << prio;
+        if (param.task.core[id] != COR_CORE_ID())
+        {
+            cor_core_wakeup_callback(param.task.core[id]);
+        }
+    }
+#else
+    if (state == COR_READY && id != 0)
+    {
+#if COR_ENABLE_STATS
+        param.coroutine[id].readyat = COR_CYCLES();
+#endif
+        cor_bitmap_set(&core->ready[prio], id);
+        core->readyprio |= 1u << prio;
+    }
+#endif
+    else if (cor_bitmap_clear(&core->ready[prio], id))
+    {
+        core->readyprio &= ~(1u << prio);
+    }
+}
+
+/**
+ * @brief Resolve a handle to its task id.
+ * @param handle Task handle, NULL for the calling task.
+ * @param id Receives the task id.
+ * @return false if the handle is out of range or its task was deleted.
+ */
+static inline bool cor_handle_id(const cor_handle_t *handle, cor_id_t *id)
+{
+    cor_id_t i;
+    if (handle == NULL)
+    {
+        *id = COR_CURRID;
+        return true;
+    }
+    i = (cor_id_t)*handle;
+    if (i >= param.cap || param.coroutine[i].gen != (cor_id_t)(*handle >> COR_ID_BITS))
+    {
+        return false;
+    }
+    *id = i;
+    return true;
+}
+/**
+ * @brief Compare two ticks, wrap-safe.
+ * @return true if tick a is before tick b.
+ */
+static inline bool cor_time_before(cor_tick_t a, cor_tick_t b)
+{
+    return (cor_stick_t)(a - b) < 0;
+}
+static void cor_sleep_place(cor_id_t pos, cor_id_t id)
+{
+    param.sleep.id[pos] = id;
+    param.task.sleepidx[id] = pos;
+}
+static void cor_sleep_sift_up(cor_id_t pos)
+{
+    cor_id_t id = param.sleep.id[pos];
+    cor_tick_t timeout = param.task.timeout[id];
+    while (pos > 0)
+    {
+        cor_id_t parent = (pos - 1) / 2;
+        if (!cor_time_before(timeout, param.task.timeout[param.sleep.id[parent]]))
+        {
+            break;
+        }
+        cor_sleep_place(pos, param.sleep.id[parent]);
+        pos = parent;
+    }
+    cor_sleep_place(pos, id);
+}
+static void cor_sleep_sift_down(cor_id_t pos)
+{
+    cor_id_t id = param.sleep.id[pos];
+    cor_tick_t timeout = param.task.timeout[id];
+    for (;;)
+    {
+        uint32_t child = (uint32_t)pos * 2 + 1;
+        if (child >= param.sleep.count)
+        {
+            break;
+        }
+        if (child + 1 < param.sleep.count &&
+            cor_time_before(param.task.timeout[param.sleep.id[child + 1]], param.task.timeout[param.sleep.id[child]]))
+        {
+            child += 1;
+        }
+        if (!cor_time_before(param.task.timeout[param.sleep.id[child]], timeout))
+        {
+            break;
+        }
+        cor_sleep_place(pos, param.sleep.id[child]);
+        pos = child;
+    }
+    cor_sleep_place(pos, id);
+}
+/**
+ * @brief Insert a task into the sleep queue.
+ * @param id Task id, its timeout must already hold the wake-up tick.
+ */
+static void cor_sleep_insert(cor_id_t id)
+{
+    param.coroutine[id].bits.insleep = 1;
+    cor_sleep_place(param.sleep.count, id);
+    param.sleep.count += 1;
+    cor_sleep_sift_up(param.task.sleepidx[id]);
+}
+/**
+ * @brief Remove a task from the sleep queue.
+ * @param id Task id, must be in the queue.
+ */
+static void cor_sleep_remove(cor_id_t id)
+{
+    cor_id_t pos = param.task.sleepidx[id];
+    param.coroutine[id].bits.insleep = 0;
+    param.sleep.count -= 1;
+    if (pos == param.sleep.count)
+    {
+        return;
+    }
+    cor_sleep_place(pos, param.sleep.id[param.sleep.count]);
+    cor_sleep_sift_down(pos);
+    cor_sleep_sift_up(param.task.sleepidx[param.sleep.id[pos]]);
+}
+
+/**
+ * @brief Reset the scheduler onto a task table
+ * @param table Task table with room for cap + 1 tasks
+ * @param cap Number of tasks
+ * @param get_tick_1ms Get tick
+ */
+static void cor_init_table(Coroutine_t *table, cor_id_t cap, uint32_t (*get_tick_1ms)(void))
+{
+    param.cap = cap + 1;
+    param.coroutine = table;
+    memset(param.coroutine, 0, sizeof(Coroutine_t) * param.cap);
+    memset(&param.task, 0, sizeof(param.task));
+    memset(&param.wait, 0, sizeof(param.wait));
+    memset(&param.job, 0, sizeof(param.job));
+    param.get_tick_1ms = get_tick_1ms;
+    param.get_tick = NULL;
+    param.hz = 1000;
+    param.tick = 0;
+    param.sleep.count = 0;
+    memset(param.core, 0, sizeof(param.core));
+    param.wakeup = 0;
+    memset((void *)param.notify, 0, sizeof(param.notify));
+    memset((void *)param.notifysum, 0, sizeof(param.notifysum));
+    param.bits.started = 0;
+    param.bits.sim = 0;
+    param.created = 0;
+    param.freelist = 0;
+#if COR_ENABLE_STACKFUL
+    param.stack.used = 0;
+    param.stack.free = NULL;
+#endif
+#if COR_POOL_SIZE > 0
+    for (uint8_t core = 0; core < COR_NUM_CORES; core++)
+    {
+        param.pool[core].used = 0;
+        memset(param.pool[core].free, 0, sizeof(param.pool[core].free));
+        param.pool[core].remote = NULL;
+    }
+    memset(param.taskctx, 0, sizeof(param.taskctx));
+#endif
+#if COR_USE_EPOLL
+    param.epfd = -1;
+    param.evfd = -1;
+    param.iowaiters = 0;
+#endif
+    param.bits.alreadyInit = 1;
+    cor_create_task(&param.idle, cor_idle_callback, NULL);
+}
+/**
+ * @brief Initialize coroutine
+ * @param cap Number of tasks
+ * @param get_tick_1ms Get tick
+ * @return true if success
+ */
+bool cor_init(cor_id_t cap, uint32_t (*get_tick_1ms)(void))
+{
+    Coroutine_t *table;
+    assert_param(get_tick_1ms != NULL);
+    if (cap > COROUTINE_MAX_SIZE - 1)
+    {
+        return false;
+    }
+#if COR_USE_MALLOC
+    table = (Coroutine_t *)malloc(sizeof(Coroutine_t) * (cap + 1));
+    if (table == NULL)
+    {
+        return false;
+    }
+    param.bits.ownTable = 1;
+#else
+    table = param.table;
+    param.bits.ownTable = 0;
+#endif
+    cor_init_table(table, cap, get_tick_1ms);
+    return true;
+}
+/**
+ * @brief Initialize coroutine on a caller owned task table
+ * @param table Task table with room for cap + 1 tasks, see COR_STATIC_TABLE
+ * @param cap Number of tasks
+ * @param get_tick_1ms Get tick
+ * @return true if success
+ */
+bool cor_init_static(Coroutine_t *table, cor_id_t cap, uint32_t (*get_tick_1ms)(void))
+{
+    assert_param(table != NULL);
+    assert_param(get_tick_1ms != NULL);
+    if (cap > COROUTINE_MAX_SIZE - 1)
+    {
+        return false;
+    }
+    param.bits.ownTable = 0;
+    cor_init_table(table, cap, get_tick_1ms);
+    return true;
+}
+/**
+ * @brief Deinitialize coroutine
+ */
+void cor_deinit(void)
+{
+#if COR_USE_MALLOC
+    if (param.coroutine != NULL && param.bits.ownTable)
+    {
+        free(param.coroutine);
+    }
+#endif
+    param.coroutine = NULL;
+    param.cap = 0;
+#if COR_USE_EPOLL
+    if (param.epfd >= 0)
+    {
+        close(param.epfd);
+        param.epfd = -1;
+    }
+    if (param.evfd >= 0)
+    {
+        close(param.evfd);
+        param.evfd = -1;
+    }
+#endif
+    // Reset all other states
+    param.bits.alreadyInit = 0;
+    param.bits.ownTable = 0;
+    // Other states reset as needed
+}
+#if COR_ENABLE_INSTANCES
+cor_sched_t *cor_sched_use(cor_sched_t *sched)
+{
+    cor_sched_t *prev = COR_SCHED_CURRENT;
+    COR_SCHED_CURRENT = sched != NULL ? sched : &cor_sched_default;
+    return prev;
+}
+cor_sched_t *cor_sched_self(void)
+{
+    return COR_SCHED_CURRENT;
+}
+size_t cor_sched_size(void)
+{
+    return sizeof(struct cor_sched);
+}
+cor_sched_t *cor_sched_create_static(void *mem, size_t len)
+{
+    cor_sched_t *sched = (cor_sched_t *)mem;
+    if (mem == NULL || len < sizeof(struct cor_sched) || (uintptr_t)mem % COR_ALIGNOF(struct cor_sched) != 0)
+    {
+        return NULL;
+    }
+    // Zeroed like the default instance before its cor_init
+    memset(sched, 0, sizeof(struct cor_sched));
+#if COR_USE_EPOLL
+    sched->epfd = -1;
+    sched->evfd = -1;
+#endif
+    return sched;
+}
+#if COR_USE_MALLOC
+cor_sched_t *cor_sched_create(void)
+{
+    void *mem = malloc(sizeof(struct cor_sched));
+    cor_sched_t *sched = cor_sched_create_static(mem, sizeof(struct cor_sched));
+    if (sched == NULL)
+    {
+        free(mem);
+        return NULL;
+    }
+    sched->bits.ownSched = 1;
+    return sched;
+}
+#endif
+void cor_sched_notify_from_isr(cor_sched_t *sched, cor_handle_t *handle)
+{
+    // The interrupted code may have any instance selected, put it back on the way out
+    cor_sched_t *prev = cor_sched_use(sched);
+    cor_notify_from_isr(handle);
+    COR_SCHED_CURRENT = prev;
+}
+void cor_sched_complete_from_isr(cor_sched_t *sched, cor_completion_t *completion)
+{
+    cor_sched_t *prev = cor_sched_use(sched);
+    cor_complete_from_isr(completion);
+    COR_SCHED_CURRENT = prev;
+}
+void cor_sched_wakeup(cor_sched_t *sched)
+{
+    cor_sched_t *prev = cor_sched_use(sched);
+    cor_wakeup();
+    COR_SCHED_CURRENT = prev;
+}
+void cor_sched_destroy(cor_sched_t *sched)
+{
+    cor_sched_t *prev;
+    assert_param(sched != NULL && sched != &cor_sched_default);
+    prev = cor_sched_use(sched);
+    cor_deinit();
+    cor_sched_use(prev == sched ? NULL : prev);
+#if COR_USE_MALLOC
+    if (sched->bits.ownSched)
+    {
+        free(sched);
+    }
+#endif
+}
+#endif
+
+/**
+ * @brief Create a task
+ * @param handle Task handle
+ * @param callback Task callback
+ * @param arg Task argument
+ * @return true if success
+ */
+bool cor_create_task(cor_handle_t *handle, void (*callback)(void *arg), void *arg)
+{
+    return cor_create_task_ex(handle, callback, arg, COR_PRIO_DEFAULT);
+}
+/**
+ * @brief Create a task with a priority
+ * @param handle Task handle
+ * @param callback Task callback
+ * @param arg Task argument
+ * @param prio Priority, 0 (lowest) to COR_PRIO_LEVELS - 1
+ * @return true if success
+ */
+bool cor_create_task_ex(cor_handle_t *handle, void (*callback)(void *arg), void *arg, uint8_t prio)
+{
+    cor_id_t id;
+    cor_id_t gen;
+    assert_param(handle != NULL);
+    assert_param(callback != NULL);
+    COR_LOCK();
+    if (param.bits.alreadyInit == 0 || prio >= COR_PRIO_LEVELS)
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    // Freed slots first, then the ones never used
+    if (param.freelist != 0)
+    {
+        id = param.freelist;
+        param.freelist = param.coroutine[id].next;
+        gen = param.coroutine[id].gen;
+    }
+    else if (param.created < param.cap)
+    {
+        id = param.created;
+        param.created += 1;
+        gen = 1;
+    }
+    else
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    memset(&param.coroutine[id], 0, sizeof(Coroutine_t));
+    param.coroutine[id].gen = gen;
+    param.task.prio[id] = prio;
+    param.task.core[id] = id % COR_NUM_CORES;
+    param.coroutine[id].affinity = COR_CORE_ANY;
+#if COR_ENABLE_WATCHDOG
+    param.coroutine[id].budget = COR_WATCHDOG_BUDGET;
+#endif
+    param.coroutine[id].callback = callback;
+    param.coroutine[id].arg = arg;
+    // Tasks created once scheduling has started join the ready set straight away
+    cor_set_state(id, param.bits.started ? COR_READY : COR_CREATED);
+    param.coroutine[id].bits.swstate = SW_NORMAL;
+    param.task.timeout[id] = 0;
+    param.coroutine[id].label = NULL;
+    param.wait.queue[id] = NULL;
+    param.wait.arg[id] = 0;
+    param.wait.msg[id] = NULL;
+    param.job.overruns[id] = 0;
+
+    *handle = COR_HANDLE(id);
+    COR_UNLOCK();
+    return true;
+}
+/**
+ * @brief Set switch state
+ * @param state Switch state
+ * @note If the task is normal, the execution of a process is SW_NORMAL. Operations interrupted in the process, such as hibernation and suspension, are SW_ABORT
+ */
+void cor_set_sw_state(switch_state_t state)
+{
+    cor_id_t id = COR_CURRID;
+    param.coroutine[id].bits.swstate = state;
+}
+void yield(void *label, cor_state_t state, cor_tick_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    COR_LOCK();
+    cor_set_state(id, state);
+    param.task.timeout[id] = timeout;
+    param.coroutine[id].label = label;
+    param.coroutine[id].bits.swstate = SW_ABORT;
+    COR_TRACE(state == COR_WAITING ? COR_TRACE_SLEEP : COR_TRACE_YIELD, id);
+    if (state == COR_WAITING)
+    {
+        // Deadlines are relative to the tick of the current dispatch
+        param.task.timeout[id] += param.tick;
+        cor_sleep_insert(id);
+    }
+    COR_UNLOCK();
+}
+void sleep_until(void *label, cor_tick_t deadline)
+{
+    cor_id_t id = COR_CURRID;
+    COR_LOCK();
+    cor_set_state(id, COR_WAITING);
+    param.task.timeout[id] = deadline;
+    param.coroutine[id].label = label;
+    param.coroutine[id].bits.swstate = SW_ABORT;
+    COR_TRACE(COR_TRACE_SLEEP, id);
+    cor_sleep_insert(id);
+    COR_UNLOCK();
+}
+void periodic(void *label, cor_tick_t period)
+{
+    cor_id_t id = COR_CURRID;
+    Coroutine_t *cor = &param.coroutine[id];
+    cor_tick_t now = cor_get_tick();
+    cor_tick_t release;
+    cor_tick_t missed;
+    if (period == 0)
+    {
+        period = 1;
+    }
+    if (cor->bits.periodic == 0)
+    {
+        param.job.release[id] = param.tick;
+        cor->bits.periodic = 1;
+    }
+    release = param.job.release[id] + period;
+    if (cor_time_before(release, now))
+    {
+        // Late: drop the releases already gone instead of running them back to back, one due right now is not late
+        missed = (now - release - 1) / period + 1;
+        release += missed * period;
+        param.job.overruns[id] = (param.job.overruns[id] + missed > 0xFFFF) ? 0xFFFF : (uint16_t)(param.job.overruns[id] + missed);
+    }
+    param.job.release[id] = release;
+#if COR_SCHED_POLICY == COR_SCHED_EDF
+    // Implicit deadline: the job released at release is due by the release after it
+    param.task.deadline[id] = release + period;
+#endif
+    sleep_until(label, release);
+}
+uint16_t cor_get_overruns(cor_handle_t *handle, bool clear)
+{
+    cor_id_t id;
+    uint16_t overruns;
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id))
+    {
+        COR_UNLOCK();
+        return 0;
+    }
+    overruns = param.job.overruns[id];
+    if (clear)
+    {
+        param.job.overruns[id] = 0;
+    }
+    COR_UNLOCK();
+    return overruns;
+}
+/**
+ * @brief Whether suspend and resume may touch a task, tasks waiting on an object are left to it.
+ * @param id Task id.
+ */
+static inline bool cor_switchable(cor_id_t id)
+{
+    cor_state_t state = param.task.state[id];
+    return state != COR_NONE && state != COR_BLOCKED && state != COR_IOWAIT && state != COR_TERMINATED;
+}
+static void cor_suspend_id(cor_id_t id)
+{
+    if (param.coroutine[id].bits.insleep)
+    {
+        cor_sleep_remove(id);
+    }
+    cor_set_state(id, COR_SUSPEND);
+    param.task.timeout[id] = 0;
+    param.coroutine[id].bits.swstate = SW_ABORT;
+    COR_TRACE(COR_TRACE_SUSPEND, id);
+}
+/**
+ * @brief Take a task being resumed off the sleep queue, its ready bit is left to the caller.
+ * @param id Task id.
+ */
+static void cor_resume_prepare(cor_id_t id)
+{
+    if (param.coroutine[id].bits.insleep)
+    {
+        cor_sleep_remove(id);
+    }
+    param.task.timeout[id] = 0;
+    COR_TRACE(COR_TRACE_RESUME, id);
+}
+/**
+ * @brief Make the tasks of one bitmap word ready, the bulk form of cor_set_state(id, COR_READY).
+ * @param w Word index, bit n stands for task w * 32 + n.
+ * @param bits Tasks to make ready, none of them on a wait queue.
+ */
+static void cor_ready_word(uint32_t w, uint32_t bits)
+{
+    uint32_t add[COR_NUM_CORES][COR_PRIO_LEVELS];
+    // The idle task is never in the ready set
+    bits &= (w == 0) ? ~1u : ~0u;
+    if (bits == 0)
+    {
+        return;
+    }
+    memset(add, 0, sizeof(add));
+    while (bits != 0)
+    {
+        cor_id_t id = (cor_id_t)(w * 32 + COR_CTZ(bits));
+        bits &= bits - 1;
+        param.task.state[id] = COR_READY;
+#if COR_NUM_CORES > 1
+        if (param.coroutine[id].bits.oncpu)
+        {
+            continue;
+        }
+#endif
+#if COR_ENABLE_STATS
+        param.coroutine[id].readyat = COR_CYCLES();
+#endif
+        add[param.task.core[id]][param.task.prio[id]] |= 1u << (id % 32);
+    }
+    for (uint8_t c = 0; c < COR_NUM_CORES; c++)
+    {
+        cor_core_t *core = &param.core[c];
+        uint32_t levels = 0;
+        for (uint8_t prio = 0; prio < COR_PRIO_LEVELS; prio++)
+        {
+            if (add[c][prio] != 0)
+            {
+                core->ready[prio].word[w] |= add[c][prio];
+                core->ready[prio].summary[w / 32] |= 1u << (w % 32);
+                levels |= 1u << prio;
+            }
+        }
+        core->readyprio |= levels;
+#if COR_NUM_CORES > 1
+        if (levels != 0 && c != COR_CORE_ID())
+        {
+            cor_core_wakeup_callback(c);
+        }
+#endif
+    }
+}
+void suspend(cor_handle_t *handle)
+{
+    cor_id_t id;
+    COR_LOCK();
+    if (cor_handle_id(handle, &id) && cor_switchable(id))
+    {
+        cor_suspend_id(id);
+    }
+    COR_UNLOCK();
+}
+void resume(cor_handle_t *handle)
+{
+    cor_id_t id;
+    COR_LOCK();
+    if (cor_handle_id(handle, &id) && cor_switchable(id))
+    {
+        cor_resume_prepare(id);
+        cor_set_state(id, COR_READY);
+    }
+    COR_UNLOCK();
+}
+void cor_resume_mask(const uint32_t *mask)
+{
+    assert_param(mask != NULL);
+    COR_LOCK();
+    for (uint32_t w = 0; w < COR_BITMAP_WORDS && w * 32 < param.cap; w++)
+    {
+        uint32_t bits = mask[w];
+        uint32_t ready = 0;
+        while (bits != 0)
+        {
+            cor_id_t id = (cor_id_t)(w * 32 + COR_CTZ(bits));
+            bits &= bits - 1;
+            if (id < param.cap && cor_switchable(id))
+            {
+                cor_resume_prepare(id);
+                ready |= 1u << (id % 32);
+            }
+        }
+        cor_ready_word(w, ready);
+    }
+    COR_UNLOCK();
+}
+void cor_resume_many(const cor_handle_t *handles, size_t n)
+{
+    uint32_t w = 0;
+    uint32_t ready = 0;
+    cor_id_t id;
+    assert_param(handles != NULL || n == 0);
+    COR_LOCK();
+    // Handles falling into the same bitmap word as the previous one are queued together
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!cor_handle_id(&handles[i], &id) || !cor_switchable(id))
+        {
+            continue;
+        }
+        if (id / 32 != w)
+        {
+            cor_ready_word(w, ready);
+            w = id / 32;
+            ready = 0;
+        }
+        cor_resume_prepare(id);
+        ready |= 1u << (id % 32);
+    }
+    cor_ready_word(w, ready);
+    COR_UNLOCK();
+}
+bool cor_group_add(cor_group_t *group, cor_handle_t *handle)
+{
+    cor_id_t id;
+    assert_param(group != NULL);
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id))
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    group->mask[id / 32] |= 1u << (id % 32);
+    COR_UNLOCK();
+    return true;
+}
+void cor_group_remove(cor_group_t *group, cor_handle_t *handle)
+{
+    // Only the slot matters, so a handle gone stale still takes its task out
+    cor_id_t id = handle == NULL ? COR_CURRID : (cor_id_t)*handle;
+    assert_param(group != NULL);
+    if (id < COROUTINE_MAX_SIZE)
+    {
+        COR_LOCK();
+        group->mask[id / 32] &= ~(1u << (id % 32));
+        COR_UNLOCK();
+    }
+}
+void cor_resume_group(const cor_group_t *group)
+{
+    assert_param(group != NULL);
+    cor_resume_mask(group->mask);
+}
+void cor_suspend_group(const cor_group_t *group)
+{
+    assert_param(group != NULL);
+    COR_LOCK();
+    for (uint32_t w = 0; w < COR_BITMAP_WORDS && w * 32 < param.cap; w++)
+    {
+        uint32_t bits = group->mask[w];
+        while (bits != 0)
+        {
+            cor_id_t id = (cor_id_t)(w * 32 + COR_CTZ(bits));
+            bits &= bits - 1;
+            // The caller keeps running, suspending it would be undone by its next wait
+            if (id != 0 && id < param.cap && id != COR_CURRID && cor_switchable(id))
+            {
+                cor_suspend_id(id);
+            }
+        }
+    }
+    COR_UNLOCK();
+}
+
+/**
+ * @brief Queue a task, behind every waiter of the same or higher priority.
+ * @param q Wait queue.
+ * @param id Task id.
+ */
+static void cor_waitq_push(cor_waitq_t *q, cor_id_t id)
+{
+    uint8_t prio = param.task.prio[id];
+    cor_id_t prev;
+    param.coroutine[id].next = 0;
+    if (q->head == 0)
+    {
+        q->head = id;
+        q->tail = id;
+        return;
+    }
+    if (param.task.prio[q->tail] >= prio)
+    {
+        param.coroutine[q->tail].next = id;
+        q->tail = id;
+        return;
+    }
+    if (param.task.prio[q->head] < prio)
+    {
+        param.coroutine[id].next = q->head;
+        q->head = id;
+        return;
+    }
+    prev = q->head;
+    while (param.task.prio[param.coroutine[prev].next] >= prio)
+    {
+        prev = param.coroutine[prev].next;
+    }
+    param.coroutine[id].next = param.coroutine[prev].next;
+    param.coroutine[prev].next = id;
+}
+/**
+ * @brief Take the first task off a wait queue.
+ * @param q Wait queue.
+ * @return Task id, 0 if the queue is empty.
+ */
+static cor_id_t cor_waitq_pop(cor_waitq_t *q)
+{
+    cor_id_t id = q->head;
+    if (id != 0)
+    {
+        q->head = param.coroutine[id].next;
+        param.wait.queue[id] = NULL;
+    }
+    return id;
+}
+/**
+ * @brief Take a task out of the middle of its wait queue, used when a wait times out.
+ * @param id Task id.
+ */
+static void cor_waitq_remove(cor_id_t id)
+{
+    cor_waitq_t *q = param.wait.queue[id];
+    cor_id_t prev;
+    if (q->head == id)
+    {
+        cor_waitq_pop(q);
+        return;
+    }
+    prev = q->head;
+    while (param.coroutine[prev].next != id)
+    {
+        prev = param.coroutine[prev].next;
+    }
+    param.coroutine[prev].next = param.coroutine[id].next;
+    if (q->tail == id)
+    {
+        q->tail = prev;
+    }
+    param.wait.queue[id] = NULL;
+}
+/**
+ * @brief Park the current task on a wait queue.
+ * @param q Wait queue, NULL for a notification wait.
+ * @param label Coroutine execution label to resume at.
+ * @param timeout Milliseconds until the wait gives up, COR_WAIT_FOREVER to wait without limit.
+ * @param trace COR_TRACE_BLOCK_* event naming the object.
+ */
+static void cor_block(cor_waitq_t *q, void *label, uint32_t timeout, uint8_t trace)
+{
+    cor_id_t id = COR_CURRID;
+    (void)trace;
+    COR_TRACE(trace, id);
+    if (q != NULL)
+    {
+        cor_waitq_push(q, id);
+    }
+    param.wait.queue[id] = q;
+    cor_set_state(id, COR_BLOCKED);
+    param.coroutine[id].label = label;
+    param.coroutine[id].bits.swstate = SW_ABORT;
+    if (timeout != COR_WAIT_FOREVER)
+    {
+        param.task.timeout[id] = param.tick + cor_ms_to_ticks(timeout);
+        cor_sleep_insert(id);
+    }
+}
+/**
+ * @brief Make a task taken off its wait queue ready again.
+ * @param id Task id.
+ * @param result Value returned by cor_wait_result in the woken task.
+ */
+static void cor_unblock(cor_id_t id, uint32_t result)
+{
+    if (param.coroutine[id].bits.insleep)
+    {
+        cor_sleep_remove(id);
+    }
+    param.wait.arg[id] = result;
+    cor_set_state(id, COR_READY);
+    COR_TRACE(COR_TRACE_WAKE, id);
+}
+uint32_t cor_wait_result(void)
+{
+    return param.wait.arg[COR_CURRID];
+}
+void *cor_wait_msg(void)
+{
+    return param.wait.msg[COR_CURRID];
+}
+
+bool mutex_lock(void *label, muxtex_handle_t *handle)
+{
+    cor_id_t id = COR_CURRID;
+    assert_param(handle != NULL);
+    COR_LOCK();
+    if (handle->owner == 0)
+    {
+        handle->owner = id + 1;
+        COR_UNLOCK();
+        return true;
+    }
+    cor_block(&handle->waiters, label, COR_WAIT_FOREVER, COR_TRACE_BLOCK_MUTEX);
+    COR_UNLOCK();
+    return false;
+}
+void mutex_unlock(muxtex_handle_t *handle)
+{
+    cor_id_t next;
+    assert_param(handle != NULL);
+    COR_LOCK();
+    if (handle->owner != COR_CURRID + 1)
+    {
+        COR_UNLOCK();
+        return;
+    }
+    // Hand the mutex straight to the first waiter, no one else is woken
+    next = cor_waitq_pop(&handle->waiters);
+    handle->owner = next == 0 ? 0 : next + 1;
+    if (next != 0)
+    {
+        cor_unblock(next, 1);
+    }
+    COR_UNLOCK();
+}
+
+bool sem_take(void *label, cor_sem_t *sem, uint32_t timeout)
+{
+    assert_param(sem != NULL);
+    COR_LOCK();
+    param.wait.arg[COR_CURRID] = 1;
+    if (sem->count > 0)
+    {
+        sem->count -= 1;
+        COR_UNLOCK();
+        return true;
+    }
+    if (timeout == 0)
+    {
+        param.wait.arg[COR_CURRID] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    cor_block(&sem->waiters, label, timeout, COR_TRACE_BLOCK_SEM);
+    COR_UNLOCK();
+    return false;
+}
+void cor_sem_give(cor_sem_t *sem)
+{
+    cor_id_t next;
+    assert_param(sem != NULL);
+    COR_LOCK();
+    // A waiter takes the count directly
+    next = cor_waitq_pop(&sem->waiters);
+    if (next != 0)
+    {
+        cor_unblock(next, 1);
+    }
+    else
+    {
+        sem->count += 1;
+    }
+    COR_UNLOCK();
+}
+
+bool notify_wait(void *label, uint32_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    COR_LOCK();
+    param.wait.arg[id] = 1;
+    if (param.coroutine[id].bits.notified)
+    {
+        param.coroutine[id].bits.notified = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    if (timeout == 0)
+    {
+        param.wait.arg[id] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    param.coroutine[id].bits.waitmode = COR_NOTIFY_PLAIN;
+    cor_block(NULL, label, timeout, COR_TRACE_BLOCK_NOTIFY);
+    COR_UNLOCK();
+    return false;
+}
+/**
+ * @brief Deliver a notification to a task.
+ * @param id Task id.
+ */
+static void cor_notify_id(cor_id_t id)
+{
+    cor_state_t state = param.task.state[id];
+    if (state == COR_IOWAIT && param.coroutine[id].bits.waitmode == COR_IO_COMPLETION &&
+        ((cor_completion_t *)param.wait.msg[id])->done)
+    {
+        ((cor_completion_t *)param.wait.msg[id])->done = 0;
+        cor_unblock(id, 1);
+    }
+    else if (state == COR_BLOCKED && param.wait.queue[id] == NULL)
+    {
+        cor_unblock(id, 1);
+    }
+    else if (state == COR_SUSPEND)
+    {
+        cor_set_state(id, COR_READY);
+    }
+    else
+    {
+        param.coroutine[id].bits.notified = 1;
+    }
+}
+void cor_notify(cor_handle_t *handle)
+{
+    cor_id_t id;
+    assert_param(handle != NULL);
+    COR_LOCK();
+    if (cor_handle_id(handle, &id))
+    {
+        cor_notify_id(id);
+    }
+    COR_UNLOCK();
+}
+/**
+ * @brief Post a notification for the dispatcher, lock-free.
+ * @param id Task id.
+ */
+static void cor_notify_post(cor_id_t id)
+{
+    // Word first, then summary: the dispatcher drains in the opposite order and never loses a bit
+    COR_ATOMIC_OR(&param.notify[id / 32], 1u << (id % 32));
+    COR_ATOMIC_OR(&param.notifysum[id / 1024], 1u << (id / 32 % 32));
+    cor_wakeup();
+}
+void cor_notify_from_isr(cor_handle_t *handle)
+{
+    cor_id_t id;
+    if (cor_handle_id(handle, &id))
+    {
+        cor_notify_post(id);
+    }
+}
+/**
+ * @brief Fold the notifications posted from interrupts into the task states.
+ */
+static void cor_process_notify(void)
+{
+    for (uint32_t s = 0; s < COR_SUMMARY_WORDS; s++)
+    {
+        uint32_t words;
+        if (param.notifysum[s] == 0)
+        {
+            continue;
+        }
+        words = COR_ATOMIC_XCHG(&param.notifysum[s], 0);
+        while (words != 0)
+        {
+            uint32_t w = s * 32 + COR_CTZ(words);
+            uint32_t bits = COR_ATOMIC_XCHG(&param.notify[w], 0);
+            words &= words - 1;
+            while (bits != 0)
+            {
+                cor_notify_id(w * 32 + COR_CTZ(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Park the current task in COR_IOWAIT.
+ * @param label Coroutine execution label to resume at.
+ * @param timeout Milliseconds until the wait gives up, COR_WAIT_FOREVER to wait without limit.
+ * @param kind COR_IO_COMPLETION or COR_IO_FD, msg holds the completion or the descriptor.
+ */
+static void cor_iowait(void *label, uint32_t timeout, uint8_t kind)
+{
+    cor_id_t id = COR_CURRID;
+    COR_TRACE(COR_TRACE_BLOCK_IO, id);
+    param.wait.queue[id] = NULL;
+    param.wait.arg[id] = 0;
+    param.coroutine[id].bits.waitmode = kind;
+    cor_set_state(id, COR_IOWAIT);
+    param.coroutine[id].label = label;
+    param.coroutine[id].bits.swstate = SW_ABORT;
+    if (timeout != COR_WAIT_FOREVER)
+    {
+        param.task.timeout[id] = param.tick + cor_ms_to_ticks(timeout);
+        cor_sleep_insert(id);
+    }
+}
+bool await_completion(void *label, cor_completion_t *completion, uint32_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    assert_param(completion != NULL);
+    COR_LOCK();
+    param.wait.arg[id] = 1;
+    if (completion->done)
+    {
+        completion->done = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    if (timeout == 0)
+    {
+        param.wait.arg[id] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    param.wait.msg[id] = completion;
+    completion->waiter = id + 1;
+    cor_iowait(label, timeout, COR_IO_COMPLETION);
+    COR_FENCE();
+    // Completed meanwhile: take the waiter back, unless the completer got it first and its wake-up is on the way
+    if (completion->done && COR_ATOMIC_XCHG(&completion->waiter, 0) != 0)
+    {
+        completion->done = 0;
+        cor_unblock(id, 1);
+    }
+    COR_UNLOCK();
+    return false;
+}
+void cor_complete(cor_completion_t *completion)
+{
+    cor_id_t waiter;
+    assert_param(completion != NULL);
+    COR_LOCK();
+    completion->done = 1;
+    COR_FENCE();
+    waiter = COR_ATOMIC_XCHG(&completion->waiter, 0);
+    if (waiter != 0)
+    {
+        cor_notify_id(waiter - 1);
+    }
+    COR_UNLOCK();
+}
+void cor_complete_from_isr(cor_completion_t *completion)
+{
+    cor_id_t waiter;
+    completion->done = 1;
+    COR_FENCE();
+    waiter = COR_ATOMIC_XCHG(&completion->waiter, 0);
+    if (waiter != 0)
+    {
+        cor_notify_post(waiter - 1);
+    }
+}
+
+#if COR_USE_EPOLL
+/* epoll data of the wake-up eventfd, never a task id */
+#define COR_IO_WAKE 0xFFFFFFFFu
+/**
+ * @brief Create the epoll instance and its wake-up eventfd on first use.
+ * @return true if epoll is usable.
+ */
+static bool cor_io_open(void)
+{
+    struct epoll_event ev;
+    if (param.epfd >= 0)
+    {
+        return true;
+    }
+    param.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (param.epfd < 0)
+    {
+        return false;
+    }
+    param.evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (param.evfd >= 0)
+    {
+        ev.events = EPOLLIN;
+        ev.data.u32 = COR_IO_WAKE;
+        epoll_ctl(param.epfd, EPOLL_CTL_ADD, param.evfd, &ev);
+    }
+    return true;
+}
+int cor_io_fd(void)
+{
+    bool ok;
+    COR_LOCK();
+    ok = cor_io_open();
+    COR_UNLOCK();
+    return ok ? param.epfd : -1;
+}
+/**
+ * @brief Whether a task already waits on a file descriptor.
+ * @param fd File descriptor.
+ * @return true if some task is in cor_await_fd on fd.
+ */
+static bool cor_io_busy(int fd)
+{
+    if (param.iowaiters == 0)
+    {
+        return false;
+    }
+    for (cor_id_t id = 1; id < param.created; id++)
+    {
+        if (param.task.state[id] == COR_IOWAIT && param.coroutine[id].bits.waitmode == COR_IO_FD &&
+            param.wait.msg[id] == (void *)(intptr_t)fd)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+bool await_fd(void *label, int fd, uint32_t events, uint32_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    struct epoll_event ev;
+    COR_LOCK();
+    // epoll keeps one registration per descriptor, a second waiter would take it over from the first
+    if (cor_io_busy(fd))
+    {
+        errno = EBUSY;
+        param.wait.arg[id] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    // One shot: the descriptor is disarmed once it fires and re-armed by the next wait
+    ev.events = events | EPOLLONESHOT;
+    ev.data.u32 = id;
+    if (!cor_io_open() ||
+        (epoll_ctl(param.epfd, EPOLL_CTL_MOD, fd, &ev) != 0 && epoll_ctl(param.epfd, EPOLL_CTL_ADD, fd, &ev) != 0))
+    {
+        param.wait.arg[id] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    param.wait.msg[id] = (void *)(intptr_t)fd;
+    param.iowaiters += 1;
+    cor_iowait(label, timeout, COR_IO_FD);
+    COR_UNLOCK();
+    return false;
+}
+/**
+ * @brief Wake the tasks whose descriptors are ready.
+ * @param timeout Milliseconds epoll_wait may block, -1 without limit.
+ */
+static void cor_io_poll(int timeout)
+{
+    struct epoll_event ev[16];
+    uint64_t drain;
+    int n;
+    if (param.epfd < 0)
+    {
+        return;
+    }
+    n = epoll_wait(param.epfd, ev, sizeof(ev) / sizeof(ev[0]), timeout);
+    COR_LOCK();
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t id = ev[i].data.u32;
+        if (id == COR_IO_WAKE)
+        {
+            if (read(param.evfd, &drain, sizeof(drain)) < 0)
+            {
+                // Already drained by another core
+            }
+            continue;
+        }
+        if (id < param.cap && param.task.state[id] == COR_IOWAIT &&
+            param.coroutine[id].bits.waitmode == COR_IO_FD)
+        {
+            param.iowaiters -= 1;
+            cor_unblock(id, ev[i].events);
+        }
+    }
+    COR_UNLOCK();
+}
+#endif
+/**
+ * @brief End an I/O wait whose timeout ran out.
+ * @param id Task id.
+ * @return false if the task has to stay parked, its completion is already being delivered.
+ */
+static bool cor_io_timeout(cor_id_t id)
+{
+    param.wait.arg[id] = 0;
+    if (param.coroutine[id].bits.waitmode == COR_IO_COMPLETION)
+    {
+        return COR_ATOMIC_XCHG(&((cor_completion_t *)param.wait.msg[id])->waiter, 0) != 0;
+    }
+#if COR_USE_EPOLL
+    epoll_ctl(param.epfd, EPOLL_CTL_DEL, (int)(intptr_t)param.wait.msg[id], NULL);
+    param.iowaiters -= 1;
+#endif
+    return true;
+}
+
+/**
+ * @brief Append a message to the channel buffer, there must be room.
+ */
+static void cor_chan_put(cor_chan_t *chan, void *msg)
+{
+    uint32_t pos = chan->head + chan->count;
+    if (pos >= chan->size)
+    {
+        pos -= chan->size;
+    }
+    chan->buf[pos] = msg;
+    chan->count += 1;
+#if COR_ENABLE_STATS
+    if (chan->count > chan->peak)
+    {
+        chan->peak = chan->count;
+    }
+#endif
+}
+bool chan_send(void *label, cor_chan_t *chan, void *msg, uint32_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    cor_id_t next;
+    assert_param(chan != NULL);
+    COR_LOCK();
+    param.wait.arg[id] = 1;
+    // A waiting receiver gets the message directly
+    next = cor_waitq_pop(&chan->receivers);
+    if (next != 0)
+    {
+        param.wait.msg[next] = msg;
+        cor_unblock(next, 1);
+        COR_UNLOCK();
+        return true;
+    }
+    if (chan->count < chan->size)
+    {
+        cor_chan_put(chan, msg);
+        COR_UNLOCK();
+        return true;
+    }
+    if (timeout == 0)
+    {
+        param.wait.arg[id] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    param.wait.msg[id] = msg;
+    cor_block(&chan->senders, label, timeout, COR_TRACE_BLOCK_CHAN);
+    COR_UNLOCK();
+    return false;
+}
+bool chan_recv(void *label, cor_chan_t *chan, uint32_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    cor_id_t next;
+    assert_param(chan != NULL);
+    COR_LOCK();
+    param.wait.arg[id] = 1;
+    next = cor_waitq_pop(&chan->senders);
+    if (chan->count > 0)
+    {
+        param.wait.msg[id] = chan->buf[chan->head];
+        chan->head = chan->head + 1 == chan->size ? 0 : chan->head + 1;
+        chan->count -= 1;
+        // The freed slot goes to the first blocked sender
+        if (next != 0)
+        {
+            cor_chan_put(chan, param.wait.msg[next]);
+            cor_unblock(next, 1);
+        }
+        COR_UNLOCK();
+        return true;
+    }
+    if (next != 0)
+    {
+        // Rendezvous, take the message straight from the sender
+        param.wait.msg[id] = param.wait.msg[next];
+        cor_unblock(next, 1);
+        COR_UNLOCK();
+        return true;
+    }
+    param.wait.msg[id] = NULL;
+    if (timeout == 0)
+    {
+        param.wait.arg[id] = 0;
+        COR_UNLOCK();
+        return true;
+    }
+    cor_block(&chan->receivers, label, timeout, COR_TRACE_BLOCK_CHAN);
+    COR_UNLOCK();
+    return false;
+}
+
+bool cor_spsc_push(cor_spsc_t *spsc, void *msg)
+{
+    uint32_t head = spsc->head;
+    cor_handle_t consumer;
+    cor_id_t id;
+    if (head - spsc->tail == spsc->size)
+    {
+        return false;
+    }
+    spsc->buf[head & (spsc->size - 1)] = msg;
+    COR_ATOMIC_STORE(&spsc->head, head + 1);
+#if COR_ENABLE_STATS
+    if (head + 1 - spsc->tail > spsc->peak)
+    {
+        spsc->peak = head + 1 - spsc->tail;
+    }
+#endif
+    // Pairs with the fence in spsc_recv, either the consumer sees the message or we see the consumer
+    COR_FENCE();
+    consumer = spsc->consumer;
+    // A consumer deleted meanwhile leaves a stale handle, its slot may hold another task by now
+    if (consumer != 0 && cor_handle_id(&consumer, &id))
+    {
+        cor_notify_post(id);
+    }
+    return true;
+}
+bool cor_spsc_pop(cor_spsc_t *spsc, void **msg)
+{
+    uint32_t tail = spsc->tail;
+    if (COR_ATOMIC_LOAD(&spsc->head) == tail)
+    {
+        return false;
+    }
+    *msg = spsc->buf[tail & (spsc->size - 1)];
+    COR_ATOMIC_STORE(&spsc->tail, tail + 1);
+    return true;
+}
+bool spsc_recv(void *label, cor_spsc_t *spsc)
+{
+    cor_id_t id = COR_CURRID;
+    assert_param(spsc != NULL);
+    COR_LOCK();
+    for (;;)
+    {
+        if (cor_spsc_pop(spsc, &param.wait.msg[id]))
+        {
+            spsc->consumer = 0;
+            COR_UNLOCK();
+            return true;
+        }
+        spsc->consumer = COR_HANDLE(id);
+        COR_FENCE();
+        if (cor_spsc_pop(spsc, &param.wait.msg[id]))
+        {
+            spsc->consumer = 0;
+            COR_UNLOCK();
+            return true;
+        }
+        // A latched notification means the ring may have filled meanwhile, look again
+        if (!notify_wait(label, COR_WAIT_FOREVER))
+        {
+            // Lets cor_delete_task take the task off the ring
+            param.coroutine[id].bits.waitmode = COR_NOTIFY_SPSC;
+            param.wait.msg[id] = spsc;
+            COR_UNLOCK();
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Get the flags that satisfy an event wait.
+ * @return Matching flags, 0 if the wait is not satisfied.
+ */
+static uint32_t cor_event_match(uint32_t flags, uint32_t mask, uint8_t mode)
+{
+    uint32_t match = flags & mask;
+    if ((mode & COR_EVENT_ALL) && match != mask)
+    {
+        return 0;
+    }
+    return match;
+}
+bool event_wait(void *label, cor_event_t *event, uint32_t mask, uint8_t mode, uint32_t timeout)
+{
+    cor_id_t id = COR_CURRID;
+    uint32_t match;
+    assert_param(event != NULL);
+    COR_LOCK();
+    match = cor_event_match(event->flags, mask, mode);
+    param.wait.arg[id] = match;
+    if (match != 0)
+    {
+        if (mode & COR_EVENT_CLEAR)
+        {
+            event->flags &= ~match;
+        }
+        COR_UNLOCK();
+        return true;
+    }
+    if (timeout == 0)
+    {
+        COR_UNLOCK();
+        return true;
+    }
+    param.wait.arg[id] = mask;
+    param.coroutine[id].bits.waitmode = mode;
+    cor_block(&event->waiters, label, timeout, COR_TRACE_BLOCK_EVENT);
+    COR_UNLOCK();
+    return false;
+}
+/**
+ * @brief Set event flags and wake every waiter they satisfy
+ * @param event Event flag group
+ * @param flags Flags to set
+ */
+void cor_event_set(cor_event_t *event, uint32_t flags)
+{
+    cor_id_t id;
+    cor_id_t prev = 0;
+    uint32_t clear = 0;
+    uint32_t w = 0;
+    uint32_t ready = 0;
+    assert_param(event != NULL);
+    COR_LOCK();
+    event->flags |= flags;
+    id = event->waiters.head;
+    while (id != 0)
+    {
+        cor_id_t next = param.coroutine[id].next;
+        uint8_t mode = param.coroutine[id].bits.waitmode;
+        uint32_t match = cor_event_match(event->flags, param.wait.arg[id], mode);
+        if (match == 0)
+        {
+            prev = id;
+            id = next;
+            continue;
+        }
+        if (mode & COR_EVENT_CLEAR)
+        {
+            clear |= match;
+        }
+        // Unlink in place, the walk already knows the previous waiter
+        if (prev == 0)
+        {
+            event->waiters.head = next;
+        }
+        else
+        {
+            param.coroutine[prev].next = next;
+        }
+        if (event->waiters.tail == id)
+        {
+            event->waiters.tail = prev;
+        }
+        param.wait.queue[id] = NULL;
+        // What cor_unblock does, with the waiters of one bitmap word made ready together
+        if (param.coroutine[id].bits.insleep)
+        {
+            cor_sleep_remove(id);
+        }
+        param.wait.arg[id] = match;
+        COR_TRACE(COR_TRACE_WAKE, id);
+        if (id / 32 != w)
+        {
+            cor_ready_word(w, ready);
+            w = id / 32;
+            ready = 0;
+        }
+        ready |= 1u << (id % 32);
+        id = next;
+    }
+    cor_ready_word(w, ready);
+    event->flags &= ~clear;
+    COR_UNLOCK();
+}
+/**
+ * @brief Clear event flags
+ * @param event Event flag group
+ * @param flags Flags to clear
+ */
+void cor_event_clear(cor_event_t *event, uint32_t flags)
+{
+    assert_param(event != NULL);
+    COR_LOCK();
+    event->flags &= ~flags;
+    COR_UNLOCK();
+}
+
+void *cor_begin(void *label)
+{
+    cor_id_t id = COR_CURRID;
+    // A task suspended before its first run has no label yet, it starts from the top as well
+    if (param.coroutine[id].bits.swstate == SW_NORMAL || param.coroutine[id].label == NULL)
+    {
+        // Starting over from the top, the next cor_periodic anchors a new loop
+        param.coroutine[id].bits.periodic = 0;
+        param.coroutine[id].bits.swstate = SW_ABORT;
+        param.coroutine[id].label = label;
+    }
+    return param.coroutine[id].label;
+}
+
+/**
+ * @brief Set the tick source
+ * @param get_tick Free running tick counter
+ * @param ticks_per_sec Tick rate
+ * @return true if success
+ */
+bool cor_set_tick_source(cor_tick_t (*get_tick)(void), uint32_t ticks_per_sec)
+{
+    if (get_tick == NULL || ticks_per_sec == 0)
+    {
+        return false;
+    }
+    COR_LOCK();
+    param.get_tick = get_tick;
+    param.hz = ticks_per_sec;
+    param.tick = get_tick();
+    COR_UNLOCK();
+    return true;
+}
+#if COR_ENABLE_SIM
+static cor_tick_t cor_sim_tick(void)
+{
+    return param.sim.now;
+}
+bool cor_sim_start(uint32_t ticks_per_sec, uint32_t seed)
+{
+    if (param.bits.alreadyInit == 0 || ticks_per_sec == 0)
+    {
+        return false;
+    }
+    param.sim.now = 0;
+    param.sim.rand = seed != 0 ? seed : 0x9E3779B9u;
+    param.bits.sim = 1;
+    return cor_set_tick_source(cor_sim_tick, ticks_per_sec);
+}
+void cor_sim_advance(cor_tick_t ticks)
+{
+    param.sim.now += ticks;
+}
+uint32_t cor_sim_random(void)
+{
+    // xorshift32, never leaves a non-zero state
+    uint32_t x = param.sim.rand;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    param.sim.rand = x;
+    return x;
+}
+/**
+ * @brief Idle under the virtual clock: skip the time in which nothing would run.
+ * @param end Tick not to move past, NULL for no limit.
+ * @return false if no task is ready or sleeping, so nothing will ever happen again.
+ */
+static bool cor_sim_skip(const cor_tick_t *end)
+{
+    cor_tick_t deadline;
+    if (param.core[0].readyprio != 0 || param.wakeup != 0)
+    {
+        return true;
+    }
+    if (!cor_next_deadline(&deadline))
+    {
+        if (end != NULL)
+        {
+            param.sim.now = *end;
+        }
+        return false;
+    }
+    if (end != NULL && cor_time_before(*end, deadline))
+    {
+        deadline = *end;
+    }
+    if (cor_time_before(param.sim.now, deadline))
+    {
+        param.sim.now = deadline;
+    }
+    return true;
+}
+#endif
+cor_tick_t cor_get_tick(void)
+{
+    if (param.get_tick != NULL)
+    {
+        return param.get_tick();
+    }
+    // Widen the 1 ms counter against the last dispatch tick, a no-op with 32 bit ticks
+    return param.tick + (uint32_t)(param.get_tick_1ms() - (uint32_t)param.tick);
+}
+cor_tick_t cor_ms_to_ticks(uint32_t ms)
+{
+    if (param.hz == 1000)
+    {
+        return ms;
+    }
+    return (cor_tick_t)(((uint64_t)ms * param.hz + 999) / 1000);
+}
+cor_tick_t cor_us_to_ticks(uint32_t us)
+{
+    return (cor_tick_t)(((uint64_t)us * param.hz + 999999) / 1000000);
+}
+
+static void cor_process_time(void)
+{
+    cor_tick_t tick = cor_get_tick();
+    param.tick = tick;
+    while (param.sleep.count > 0)
+    {
+        cor_id_t id = param.sleep.id[0];
+        if (cor_time_before(tick, param.task.timeout[id]))
+        {
+            break;
+        }
+        cor_sleep_remove(id);
+        if (param.task.state[id] == COR_BLOCKED)
+        {
+            // A wait with a timeout ran out
+            if (param.wait.queue[id] != NULL)
+            {
+                cor_waitq_remove(id);
+            }
+            param.wait.arg[id] = 0;
+        }
+        else if (param.task.state[id] == COR_IOWAIT && !cor_io_timeout(id))
+        {
+            continue;
+        }
+        param.task.timeout[id] = 0;
+        cor_set_state(id, COR_READY);
+        COR_TRACE(COR_TRACE_TIMEOUT, id);
+    }
+}
+
+#if COR_POOL_SIZE > 0
+void *cor_pool_alloc(size_t size)
+{
+    uint8_t core = COR_CORE_ID();
+    cor_pool_t *pool = &param.pool[core];
+    cor_pool_block_t *block;
+    uint32_t bytes;
+    uint8_t cls = 0;
+    while (cls < COR_POOL_CLASSES && ((size_t)16 << cls) < size)
+    {
+        cls++;
+    }
+    if (cls == COR_POOL_CLASSES)
+    {
+        return NULL;
+    }
+#if COR_NUM_CORES > 1 || COR_ENABLE_INSTANCES
+    // Take back what other cores or instances freed, each block to the freelist of its class
+    if (pool->remote != NULL)
+    {
+        block = (cor_pool_block_t *)COR_ATOMIC_XCHG(&pool->remote, NULL);
+        while (block != NULL)
+        {
+            cor_pool_block_t *next = block->next;
+            block->next = pool->free[block->cls];
+            pool->free[block->cls] = block;
+            block = next;
+        }
+    }
+#endif
+    block = pool->free[cls];
+    if (block != NULL)
+    {
+        pool->free[cls] = block->next;
+        return (uint8_t *)block + COR_POOL_HEADER;
+    }
+    bytes = COR_POOL_HEADER + ((uint32_t)16 << cls);
+    if (bytes > COR_POOL_SIZE - pool->used)
+    {
+        return NULL;
+    }
+    block = (cor_pool_block_t *)&pool->mem[pool->used];
+    pool->used += bytes;
+    block->cls = cls;
+    block->core = core;
+#if COR_ENABLE_INSTANCES
+    block->sched = &param;
+#endif
+    return (uint8_t *)block + COR_POOL_HEADER;
+}
+/**
+ * @brief Whether the caller may use the freelists of the pool a block came from.
+ * @param block Pool block.
+ * @return true on the core, and with instances the instance, that carved the block.
+ */
+static inline bool cor_pool_owner(const cor_pool_block_t *block)
+{
+#if COR_ENABLE_INSTANCES
+    // The caller may have another instance selected than the one the block came from
+    if (block->sched != &param)
+    {
+        return false;
+    }
+#endif
+    return block->core == COR_CORE_ID();
+}
+void cor_pool_free(void *ptr)
+{
+    cor_pool_block_t *block;
+    cor_pool_t *pool;
+    if (ptr == NULL)
+    {
+        return;
+    }
+    block = (cor_pool_block_t *)((uint8_t *)ptr - COR_POOL_HEADER);
+#if COR_ENABLE_INSTANCES
+    pool = &block->sched->pool[block->core];
+#else
+    pool = &param.pool[block->core];
+#endif
+#if COR_NUM_CORES > 1 || COR_ENABLE_INSTANCES
+    if (!cor_pool_owner(block))
+    {
+        // Only the owner pops its freelists, other cores and instances hand blocks over through remote
+        block->next = pool->remote;
+        while (!COR_ATOMIC_CAS(&pool->remote, &block->next, block))
+        {
+        }
+        return;
+    }
+#endif
+    block->next = pool->free[block->cls];
+    pool->free[block->cls] = block;
+}
+bool cor_create_task_ctx(cor_handle_t *handle, void (*callback)(void *arg), uint32_t size, uint8_t prio, void **ctx)
+{
+    void *arg = cor_pool_alloc(size);
+    cor_id_t id = 0;
+    if (arg == NULL)
+    {
+        return false;
+    }
+    memset(arg, 0, size);
+    if (ctx != NULL)
+    {
+        *ctx = arg;
+    }
+    COR_LOCK();
+    if (!cor_create_task_ex(handle, callback, arg, prio))
+    {
+        COR_UNLOCK();
+        cor_pool_free(arg);
+        return false;
+    }
+    // Marked under the lock, the slot cannot be freed before it owns the context
+    cor_handle_id(handle, &id);
+    param.taskctx[id / 32] |= 1u << (id % 32);
+    COR_UNLOCK();
+    return true;
+}
+#endif
+
+/**
+ * @brief Return a slot to the free list, the task must be off every queue.
+ * @param id Task id.
+ */
+static void cor_free_slot(cor_id_t id)
+{
+    cor_set_state(id, COR_NONE);
+#if COR_ENABLE_STACKFUL
+    if (param.coroutine[id].bits.stackful)
+    {
+        cor_stack_block_t *block = param.coroutine[id].stack;
+        block->next = param.stack.free;
+        param.stack.free = block;
+        param.coroutine[id].bits.stackful = 0;
+    }
+#endif
+#if COR_POOL_SIZE > 0
+    if (param.taskctx[id / 32] & (1u << (id % 32)))
+    {
+        param.taskctx[id / 32] &= ~(1u << (id % 32));
+        cor_pool_free(param.coroutine[id].arg);
+    }
+#endif
+    // A reused slot starts a fresh periodic loop
+    param.coroutine[id].bits.periodic = 0;
+    param.job.overruns[id] = 0;
+    param.coroutine[id].next = param.freelist;
+    param.freelist = id;
+}
+bool cor_delete_task(cor_handle_t *handle)
+{
+    cor_id_t id;
+    cor_id_t gen;
+    cor_state_t state;
+    bool running;
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id) || id == 0)
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    state = param.task.state[id];
+    if (state == COR_NONE || state == COR_TERMINATED)
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    if (param.coroutine[id].bits.insleep)
+    {
+        cor_sleep_remove(id);
+    }
+    if (state == COR_BLOCKED && param.wait.queue[id] != NULL)
+    {
+        cor_waitq_remove(id);
+    }
+    else if (state == COR_BLOCKED && param.coroutine[id].bits.waitmode == COR_NOTIFY_SPSC &&
+             ((cor_spsc_t *)param.wait.msg[id])->consumer == COR_HANDLE(id))
+    {
+        ((cor_spsc_t *)param.wait.msg[id])->consumer = 0;
+    }
+    else if (state == COR_IOWAIT)
+    {
+        cor_io_timeout(id);
+    }
+    // Bumping the generation makes every handle of the task stale right away,
+    // the cast wraps it at the field width so 0 is skipped
+    gen = (cor_id_t)(param.coroutine[id].gen + 1);
+    param.coroutine[id].gen = gen == 0 ? 1 : gen;
+    cor_set_state(id, COR_TERMINATED);
+#if COR_NUM_CORES > 1
+    running = param.coroutine[id].bits.oncpu;
+#else
+    running = id == COR_CURRID;
+#endif
+    // A task still inside its callback keeps the slot until cor_exec is done with it
+    if (!running)
+    {
+        cor_free_slot(id);
+    }
+    COR_UNLOCK();
+    return true;
+}
+void task_exit(void)
+{
+    cor_handle_t handle;
+    COR_LOCK();
+    handle = COR_HANDLE(COR_CURRID);
+    cor_delete_task(&handle);
+    COR_UNLOCK();
+}
+
+#if COR_ENABLE_STACKFUL
+/**
+ * @brief Save the callee-saved registers on the current stack, store its pointer in *save
+ *        and resume the context saved on sp.
+ * @param save Where the stack pointer of the current context goes.
+ * @param sp Stack pointer saved by an earlier switch, or laid out by cor_stack_frame.
+ */
+void cor_ctx_switch(void **save, void *sp);
+#if defined(__x86_64__) && !defined(_WIN32)
+#define COR_CTX_WORDS 6 /* rbp, rbx, r12 to r15 */
+__asm__(".pushsection .text\n"
+        ".globl cor_ctx_switch\n"
+        ".type cor_ctx_switch, @function\n"
+        "cor_ctx_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size cor_ctx_switch, .-cor_ctx_switch\n"
+        ".popsection\n");
+#elif defined(__arm__) && defined(__thumb2__)
+#if defined(__ARM_FP)
+#define COR_CTX_WORDS 24 /* s16 to s31, r4 to r11 */
+#define COR_CTX_VPUSH "    vpush {s16-s31}\n"
+#define COR_CTX_VPOP "    vpop {s16-s31}\n"
+#else
+#define COR_CTX_WORDS 8 /* r4 to r11 */
+#define COR_CTX_VPUSH
+#define COR_CTX_VPOP
+#endif
+__asm__(".pushsection .text\n"
+        ".syntax unified\n"
+        ".thumb\n"
+        ".globl cor_ctx_switch\n"
+        ".type cor_ctx_switch, %function\n"
+        ".thumb_func\n"
+        "cor_ctx_switch:\n"
+        "    push {r4-r11, lr}\n" COR_CTX_VPUSH
+        "    mov r2, sp\n"
+        "    str r2, [r0]\n"
+        "    mov sp, r1\n" COR_CTX_VPOP
+        "    pop {r4-r11, pc}\n"
+        ".size cor_ctx_switch, .-cor_ctx_switch\n"
+        ".popsection\n");
+#else
+#error "COR_ENABLE_STACKFUL: no context switch for this architecture"
+#endif
+
+/**
+ * @brief First code run on the stack of a stackful task, never returns.
+ */
+static void cor_stack_main(void)
+{
+    cor_id_t id = COR_CURRID;
+    param.coroutine[id].callback(param.coroutine[id].arg);
+    // The slot and the stack are freed by cor_exec once back on the scheduler stack
+    cor_stack_exit();
+}
+/**
+ * @brief Take a stack from the pool.
+ * @param size Usable bytes.
+ * @return Block, NULL if the pool is exhausted.
+ */
+static cor_stack_block_t *cor_stack_alloc(uint32_t size)
+{
+    cor_stack_block_t **link = &param.stack.free;
+    cor_stack_block_t *block;
+    size = (size + COR_STACK_HEADER + 15u) & ~15u;
+    // Blocks of deleted tasks are taken whole, first fit
+    for (block = *link; block != NULL; link = &block->next, block = *link)
+    {
+        if (block->size >= size)
+        {
+            *link = block->next;
+            return block;
+        }
+    }
+    if (size > COR_STACK_POOL_SIZE - param.stack.used)
+    {
+        return NULL;
+    }
+    block = (cor_stack_block_t *)&param.stack.pool[param.stack.used];
+    block->size = size;
+    param.stack.used += size;
+    return block;
+}
+/**
+ * @brief Lay out the frame that the first cor_ctx_switch to a new stack pops.
+ * @param block Stack block.
+ * @return Initial stack pointer.
+ */
+static void *cor_stack_frame(cor_stack_block_t *block)
+{
+    uintptr_t *sp = (uintptr_t *)((uint8_t *)block + block->size);
+    memset((uint8_t *)block + COR_STACK_HEADER, COR_STACK_PAINT, block->size - COR_STACK_HEADER);
+    *(uint32_t *)((uint8_t *)block + COR_STACK_HEADER) = COR_STACK_GUARD;
+#if defined(__x86_64__)
+    // A null return address above the entry keeps the stack aligned as after a call
+    sp -= COR_CTX_WORDS + 2;
+    memset(sp, 0, sizeof(uintptr_t) * (COR_CTX_WORDS + 2));
+#else
+    sp -= COR_CTX_WORDS + 1;
+    memset(sp, 0, sizeof(uintptr_t) * (COR_CTX_WORDS + 1));
+#endif
+    sp[COR_CTX_WORDS] = (uintptr_t)cor_stack_main;
+    return sp;
+}
+bool cor_create_stackful_task(cor_handle_t *handle, void (*entry)(void *arg), void *arg, uint8_t prio, uint32_t stack_size)
+{
+    cor_stack_block_t *block;
+    cor_id_t id = 0;
+    assert_param(stack_size >= 128);
+    COR_LOCK();
+    block = cor_stack_alloc(stack_size);
+    if (block == NULL)
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    if (!cor_create_task_ex(handle, entry, arg, prio))
+    {
+        block->next = param.stack.free;
+        param.stack.free = block;
+        COR_UNLOCK();
+        return false;
+    }
+    // Still under the lock, no core can dispatch the task before its stack is in place
+    cor_handle_id(handle, &id);
+    param.coroutine[id].stack = block;
+    param.coroutine[id].sp = cor_stack_frame(block);
+    param.coroutine[id].bits.stackful = 1;
+    COR_UNLOCK();
+    return true;
+}
+uint32_t cor_stack_high_water(cor_handle_t *handle)
+{
+    cor_id_t id;
+    cor_stack_block_t *block;
+    uint8_t *p;
+    uint8_t *top;
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id) || !param.coroutine[id].bits.stackful)
+    {
+        COR_UNLOCK();
+        return 0;
+    }
+    block = param.coroutine[id].stack;
+    top = (uint8_t *)block + block->size;
+    // The stack grows down, the lowest byte no longer painted marks the deepest use
+    p = (uint8_t *)block + COR_STACK_HEADER + sizeof(uint32_t);
+    while (p < top && *p == COR_STACK_PAINT)
+    {
+        p++;
+    }
+    COR_UNLOCK();
+    return (uint32_t)(top - p);
+}
+void cor_stack_switch(void)
 {
-    Coroutine_t *coroutine;
-    uint32_t (*get_tick_1ms)(void);
-    uint32_t tick;
-    struct
+    cor_id_t id = COR_CURRID;
+    assert_param(param.coroutine[id].bits.stackful);
+    cor_ctx_switch(&param.coroutine[id].sp, param.core[COR_CORE_ID()].schedsp);
+}
+void cor_stack_yield(void)
+{
+    yield(NULL, COR_READY, 0);
+    cor_stack_switch();
+}
+void cor_stack_sleep(uint32_t ms)
+{
+    yield(NULL, COR_WAITING, cor_ms_to_ticks(ms));
+    cor_stack_switch();
+}
+void cor_stack_sleep_until(cor_tick_t deadline)
+{
+    sleep_until(NULL, deadline);
+    cor_stack_switch();
+}
+void cor_stack_suspend(void)
+{
+    suspend(NULL);
+    cor_stack_switch();
+}
+void cor_stack_exit(void)
+{
+    task_exit();
+    cor_stack_switch();
+}
+void cor_stack_mutex_lock(muxtex_handle_t *handle)
+{
+    if (!mutex_lock(NULL, handle))
     {
-        uint8_t cap : 5;
-        uint8_t currid : 5;
-        uint8_t alreadyInit : 1;
-    } bits;
-} param;
-/**
- * @brief Switch to the next node.
- * @param currid Current id.
- * @return Next id.
- */
-static uint8_t cor_get_next_id(uint8_t currid)
+        cor_stack_switch();
+    }
+}
+bool cor_stack_sem_take(cor_sem_t *sem, uint32_t timeout)
+{
+    if (!sem_take(NULL, sem, timeout))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_result() != 0;
+}
+bool cor_stack_notify_wait(uint32_t timeout)
+{
+    if (!notify_wait(NULL, timeout))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_result() != 0;
+}
+uint32_t cor_stack_event_wait(cor_event_t *event, uint32_t mask, uint8_t mode, uint32_t timeout)
+{
+    if (!event_wait(NULL, event, mask, mode, timeout))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_result();
+}
+bool cor_stack_chan_send(cor_chan_t *chan, void *msg, uint32_t timeout)
+{
+    if (!chan_send(NULL, chan, msg, timeout))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_result() != 0;
+}
+bool cor_stack_chan_recv(cor_chan_t *chan, void **out, uint32_t timeout)
+{
+    if (!chan_recv(NULL, chan, timeout))
+    {
+        cor_stack_switch();
+    }
+    *out = cor_wait_msg();
+    return cor_wait_result() != 0;
+}
+void *cor_stack_spsc_recv(cor_spsc_t *spsc)
+{
+    // Every wake-up only means the ring may have filled, look again
+    while (!spsc_recv(NULL, spsc))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_msg();
+}
+bool cor_stack_await_completion(cor_completion_t *completion, uint32_t timeout)
+{
+    if (!await_completion(NULL, completion, timeout))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_result() != 0;
+}
+#if COR_USE_EPOLL
+uint32_t cor_stack_await_fd(int fd, uint32_t events, uint32_t timeout)
 {
-    return (currid + 1) % param.bits.cap;
+    if (!await_fd(NULL, fd, events, timeout))
+    {
+        cor_stack_switch();
+    }
+    return cor_wait_result();
 }
+#endif
+#endif
 
-/**
- * @brief Initialize coroutine
- * @param cap Number of tasks
- * @param get_tick_1ms Get tick
- * @return true if success
- */
-bool cor_init(uint8_t cap, uint32_t (*get_tick_1ms)(void))
+void cor_footprint_get(cor_footprint_t *out)
 {
-    assert_param(get_tick_1ms != NULL);
-    if (cap > COROUTINE_MAX_SIZE - 1)
+    assert_param(out != NULL);
+    COR_LOCK();
+    out->kernel = sizeof(param);
+#if !COR_USE_MALLOC
+    // Counted as the table below
+    out->kernel -= sizeof(param.table);
+#endif
+#if COR_ENABLE_STACKFUL
+    out->kernel -= sizeof(param.stack.pool);
+    out->stack_pool = COR_STACK_POOL_SIZE;
+    out->stack_used = param.stack.used;
+#else
+    out->stack_pool = 0;
+    out->stack_used = 0;
+#endif
+    out->pool = 0;
+    out->pool_used = 0;
+#if COR_POOL_SIZE > 0
+    out->kernel -= sizeof(param.pool);
+    for (uint8_t core = 0; core < COR_NUM_CORES; core++)
+    {
+        out->pool += COR_POOL_SIZE;
+        out->pool_used += param.pool[core].used;
+    }
+#endif
+    out->entry = sizeof(Coroutine_t);
+    out->table = sizeof(Coroutine_t) * param.cap;
+    out->cap = param.cap > 0 ? param.cap - 1 : 0;
+    // Freed slots are reused before new ones, so the slots ever handed out are the peak in use
+    out->used = param.created > 0 ? param.created - 1 : 0;
+    COR_UNLOCK();
+}
+
+#if COR_ENABLE_STATS
+bool cor_stats_get(cor_handle_t *handle, cor_stats_t *out)
+{
+    cor_id_t id;
+    if (handle == NULL || out == NULL)
     {
         return false;
     }
-    param.bits.cap = cap + 1;
-    param.coroutine = (Coroutine_t *)malloc(sizeof(Coroutine_t) * param.bits.cap);
-    if (param.coroutine == NULL)
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id))
     {
+        COR_UNLOCK();
         return false;
     }
-    memset(param.coroutine, 0, sizeof(Coroutine_t) * param.bits.cap);
-    param.get_tick_1ms = get_tick_1ms;
-    param.tick = 0;
-    param.bits.currid = 0;
-    param.bits.alreadyInit = 1;
-    cor_create_task(&CorIdleHandle, cor_idle_callback, NULL);
+    *out = param.coroutine[id].stats;
+    COR_UNLOCK();
     return true;
 }
-/**
- * @brief Deinitialize coroutine
- */
-void cor_deinit(void)
+void cor_stats_reset(cor_handle_t *handle)
 {
-    if (param.coroutine != NULL)
+    cor_id_t id;
+    if (handle == NULL)
     {
-        free(param.coroutine);
-        param.coroutine = NULL;
+        return;
     }
-    // Reset all other states
-    param.bits.alreadyInit = 0;
-    // Other states reset as needed
+    COR_LOCK();
+    if (cor_handle_id(handle, &id))
+    {
+        memset(&param.coroutine[id].stats, 0, sizeof(cor_stats_t));
+    }
+    COR_UNLOCK();
 }
-
-/**
- * @brief Create a task
- * @param handle Task handle
- * @param callback Task callback
- * @param arg Task argument
- * @return true if success
- */
-bool cor_create_task(cor_handle_t *handle, void (*callback)(void *arg), void *arg)
+#endif
+#if COR_ENABLE_WATCHDOG
+bool cor_set_budget(cor_handle_t *handle, uint32_t cycles)
 {
-    static uint8_t id = 0;
-    assert_param(handle != NULL);
-    assert_param(callback != NULL);
-    if (param.bits.alreadyInit == 0 || id >= param.bits.cap)
+    cor_id_t id;
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id))
     {
+        COR_UNLOCK();
         return false;
     }
-    param.coroutine[id].callback = callback;
-    param.coroutine[id].arg = arg;
-    param.coroutine[id].bits.state = COR_CREATED;
-    param.coroutine[id].bits.swstate = SW_NORMAL;
-    param.coroutine[id].timeout = 0;
-    param.coroutine[id].label = NULL;
-
-    *handle = id;
-    id += 1;
+    param.coroutine[id].budget = cycles;
+    COR_UNLOCK();
     return true;
 }
-/**
- * @brief Set switch state
- * @param state Switch state
- * @note If the task is normal, the execution of a process is SW_NORMAL. Operations interrupted in the process, such as hibernation and suspension, are SW_ABORT
- */
-void cor_set_sw_state(switch_state_t state)
+uint16_t cor_get_hogs(cor_handle_t *handle, bool clear)
 {
-    uint8_t id = param.bits.currid;
-    param.coroutine[id].bits.swstate = state;
+    cor_id_t id;
+    uint16_t hogs;
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id))
+    {
+        COR_UNLOCK();
+        return 0;
+    }
+    hogs = param.coroutine[id].hogs;
+    if (clear)
+    {
+        param.coroutine[id].hogs = 0;
+    }
+    COR_UNLOCK();
+    return hogs;
 }
-void yield(void *label, cor_state_t state, uint32_t timeout)
+#endif
+#if COR_TRACE_SIZE > 0
+size_t cor_trace_export(void *buf, size_t len)
 {
-    uint8_t id = param.bits.currid;
-    param.coroutine[id].bits.state = state;
-    param.coroutine[id].timeout = timeout;
-    param.coroutine[id].label = label;
-    param.coroutine[id].bits.swstate = SW_ABORT;
+    cor_trace_header_t header;
+    uint32_t first;
+    uint32_t i;
+    if (buf == NULL || len < sizeof(header))
+    {
+        return 0;
+    }
+    COR_LOCK();
+    header.magic = COR_TRACE_MAGIC;
+    header.version = COR_TRACE_VERSION;
+    header.size = sizeof(cor_trace_event_t);
+#ifdef COR_TRACE_HZ
+    header.hz = COR_TRACE_HZ;
+#else
+    header.hz = param.hz;
+#endif
+    header.count = param.trace.head < COR_TRACE_SIZE ? param.trace.head : COR_TRACE_SIZE;
+    if (header.count > (len - sizeof(header)) / sizeof(cor_trace_event_t))
+    {
+        header.count = (len - sizeof(header)) / sizeof(cor_trace_event_t);
+    }
+    first = param.trace.head < COR_TRACE_SIZE ? 0 : param.trace.head - COR_TRACE_SIZE;
+    header.dropped = first;
+    memcpy(buf, &header, sizeof(header));
+    for (i = 0; i < header.count; i++)
+    {
+        memcpy((uint8_t *)buf + sizeof(header) + i * sizeof(cor_trace_event_t),
+               &param.trace.event[(first + i) & (COR_TRACE_SIZE - 1)], sizeof(cor_trace_event_t));
+    }
+    COR_UNLOCK();
+    return sizeof(header) + header.count * sizeof(cor_trace_event_t);
 }
-void suspend(cor_handle_t *handle)
+void cor_trace_clear(void)
 {
-    uint8_t id = *handle;
-    if (handle == NULL)
+    COR_LOCK();
+    param.trace.head = 0;
+    COR_UNLOCK();
+}
+#endif
+bool cor_next_deadline(cor_tick_t *deadline)
+{
+    bool any;
+    COR_LOCK();
+    any = param.sleep.count > 0;
+    if (any)
     {
-        id = param.bits.currid;
+        *deadline = param.task.timeout[param.sleep.id[0]];
     }
-    param.coroutine[id].bits.state = COR_SUSPEND;
-    param.coroutine[id].timeout = 0;
-    param.coroutine[id].bits.swstate = SW_ABORT;
+    COR_UNLOCK();
+    return any;
 }
-void resume(cor_handle_t *handle)
+uint32_t cor_next_timeout(void)
 {
-    uint8_t id = *handle;
-    if (handle == NULL)
+    cor_tick_t deadline;
+    cor_stick_t remain;
+    uint64_t ms;
+    if (!cor_next_deadline(&deadline))
+    {
+        return COR_WAIT_FOREVER;
+    }
+    remain = (cor_stick_t)(deadline - cor_get_tick());
+    if (remain <= 0)
+    {
+        return 0;
+    }
+    ms = (uint64_t)remain * 1000 / param.hz;
+    return ms < COR_WAIT_FOREVER ? (uint32_t)ms : COR_WAIT_FOREVER - 1;
+}
+void cor_wakeup(void)
+{
+    param.wakeup = 1;
+#if COR_USE_EPOLL
+    if (param.evfd >= 0)
     {
-        id = param.bits.currid;
+        uint64_t one = 1;
+        // Async-signal-safe, so this also works from signal handlers and other threads
+        if (write(param.evfd, &one, sizeof(one)) < 0)
+        {
+            // Counter saturated, a wake-up is pending anyway
+        }
     }
-    param.coroutine[id].bits.state = COR_READY;
-    param.coroutine[id].timeout = 0;
+#endif
+}
+bool cor_wakeup_pending(void)
+{
+    return param.wakeup != 0;
 }
 
-void mutex_lock(muxtex_handle_t *handle)
+#if COR_NUM_CORES > 1
+/**
+ * @brief Move a task to another core, keeping its state.
+ * @param id Task id.
+ * @param core Core index.
+ */
+static void cor_migrate(cor_id_t id, uint8_t core)
 {
-    assert_param(handle != NULL);
-    if (*handle == 0)
+    cor_state_t state = param.task.state[id];
+    // Unlink from the old core's ready set, then link into the new one
+    cor_set_state(id, COR_SUSPEND);
+    param.task.core[id] = core;
+    cor_set_state(id, state);
+}
+/**
+ * @brief Take an unpinned ready task from a core that is busy running another one.
+ * @param self Core index of the caller.
+ * @return true if a task was moved to this core.
+ */
+static bool cor_steal(uint8_t self)
+{
+    for (uint8_t c = 0; c < COR_NUM_CORES; c++)
     {
-        *handle |= 1 << param.bits.currid;
+        cor_core_t *victim = &param.core[c];
+        if (c == self || victim->currid == 0 || victim->readyprio == 0)
+        {
+            continue;
+        }
+        for (int prio = COR_PRIO_LEVELS - 1; prio >= 0; prio--)
+        {
+            int32_t id = cor_bitmap_find(&victim->ready[prio], 0);
+            while (id >= 0)
+            {
+                // Never a task some core is running or has just picked
+                if (param.coroutine[id].affinity == COR_CORE_ANY && !param.coroutine[id].bits.oncpu &&
+                    (cor_id_t)id != victim->currid)
+                {
+                    cor_migrate((cor_id_t)id, self);
+                    return true;
+                }
+                id = cor_bitmap_find(&victim->ready[prio], (uint32_t)id + 1);
+            }
+        }
     }
-    else
+    return false;
+}
+bool cor_set_affinity(cor_handle_t *handle, uint8_t core)
+{
+    cor_id_t id;
+    if (handle == NULL || (core >= COR_NUM_CORES && core != COR_CORE_ANY))
+    {
+        return false;
+    }
+    COR_LOCK();
+    if (!cor_handle_id(handle, &id))
+    {
+        COR_UNLOCK();
+        return false;
+    }
+    param.coroutine[id].affinity = core;
+    if (core != COR_CORE_ANY && param.task.core[id] != core)
     {
-        param.coroutine[param.bits.currid].bits.state = COR_BLOCKED;
-        param.coroutine[param.bits.currid].bits.swstate = SW_ABORT;
+        cor_migrate(id, core);
     }
+    COR_UNLOCK();
+    return true;
 }
-void mutex_unlock(muxtex_handle_t *handle)
+#else
+bool cor_set_affinity(cor_handle_t *handle, uint8_t core)
 {
-    assert_param(handle != NULL);
-    *handle &= ~(1 << param.bits.currid);
+    (void)handle;
+    return core == 0 || core == COR_CORE_ANY;
 }
+#endif
 
-void *cor_begin(void *label)
+/**
+ * @brief Round robin within a level: the lowest ready id after the last one dispatched, else wrap around.
+ * @param core Scheduler state of the calling core.
+ * @param prio Level, it must have a ready task.
+ */
+static inline cor_id_t cor_pick_rr(cor_core_t *core, uint8_t prio)
 {
-    uint8_t id = param.bits.currid;
-    if (param.coroutine[id].bits.swstate == SW_NORMAL)
+    int32_t next = cor_bitmap_find(&core->ready[prio], (uint32_t)core->last[prio] + 1);
+    if (next < 0)
     {
-        param.coroutine[id].bits.swstate = SW_ABORT;
-        param.coroutine[id].label = label;
+        next = cor_bitmap_find(&core->ready[prio], 0);
     }
-    return param.coroutine[id].label;
+    return (cor_id_t)next;
 }
-
-static void cor_process_time(void)
+#if COR_SCHED_POLICY == COR_SCHED_EDF
+/**
+ * @brief Earliest deadline first within a level, equal deadlines go to the lowest id.
+ * @param core Scheduler state of the calling core.
+ * @param prio Level, it must have a ready task.
+ * @note Only pending jobs count: released by cor_periodic and not yet past their deadline. A task that
+ *       stopped calling cor_periodic, or overran its job, falls back to round robin with the others.
+ */
+static cor_id_t cor_pick(cor_core_t *core, uint8_t prio)
 {
-    uint32_t tick = param.get_tick_1ms();
-    uint32_t counter = tick - param.tick;
-    for (int i = 0; i < param.bits.cap; i++)
+    int32_t id = cor_bitmap_find(&core->ready[prio], 0);
+    int32_t best = -1;
+    while (id >= 0)
     {
-        if (param.coroutine[i].bits.state != COR_WAITING)
+        if (param.coroutine[id].bits.periodic && cor_time_before(param.tick, param.task.deadline[id]) &&
+            (best < 0 || cor_time_before(param.task.deadline[id], param.task.deadline[best])))
         {
-            continue;
+            best = id;
         }
+        id = cor_bitmap_find(&core->ready[prio], (uint32_t)id + 1);
+    }
+    // No pending job ready, the rest share the CPU as under COR_SCHED_PRIO
+    return best < 0 ? cor_pick_rr(core, prio) : (cor_id_t)best;
+}
+#else
+#define cor_pick(core, prio) cor_pick_rr((core), (prio))
+#endif
 
-        if (param.coroutine[i].timeout > counter)
+static void cor_dispatch(void)
+{
+    cor_core_t *core = &param.core[COR_CORE_ID()];
+    uint8_t prio;
+    COR_LOCK();
+    param.wakeup = 0;
+    cor_process_notify();
+#if COR_USE_EPOLL
+    if (param.iowaiters > 0)
+    {
+        cor_io_poll(0);
+    }
+#endif
+    cor_process_time();
+#if COR_NUM_CORES > 1
+    if (core->readyprio == 0 && !cor_steal(COR_CORE_ID()))
+#else
+    if (core->readyprio == 0)
+#endif
+    {
+        // Back to back idle passes make one idle slice, only its start is recorded
+        if (core->currid != 0)
         {
-            param.coroutine[i].timeout -= counter;
+            COR_TRACE(COR_TRACE_DISPATCH, 0);
         }
-        else
+        core->currid = 0;
+        COR_UNLOCK();
+        return;
+    }
+    // Highest non-empty level, then the policy picks within it
+    prio = 31 - COR_CLZ(core->readyprio);
+    core->currid = cor_pick(core, prio);
+    core->last[prio] = core->currid;
+    // Off the ready set before the lock is dropped, no other core can steal it from here on
+#if COR_NUM_CORES > 1
+    param.coroutine[core->currid].bits.oncpu = 1;
+#endif
+    cor_set_state(core->currid, COR_RUNNING);
+    COR_TRACE(COR_TRACE_DISPATCH, core->currid);
+    COR_UNLOCK();
+}
+
+static void cor_exec(void)
+{
+    cor_id_t id = COR_CURRID;
+#if COR_ENABLE_STATS || COR_ENABLE_WATCHDOG
+    uint32_t start;
+    uint32_t spent;
+#endif
+    // cor_dispatch has marked the task RUNNING and oncpu already
+#if COR_ENABLE_STATS || COR_ENABLE_WATCHDOG
+    start = COR_CYCLES();
+#endif
+#if COR_ENABLE_STATS
+    if (id != 0 && start - param.coroutine[id].readyat > param.coroutine[id].stats.max_latency)
+    {
+        param.coroutine[id].stats.max_latency = start - param.coroutine[id].readyat;
+    }
+#endif
+#if COR_ENABLE_STACKFUL
+    if (param.coroutine[id].bits.stackful)
+    {
+        // Back here once the task waits or ends, its stack must not have overflowed
+        cor_ctx_switch(&param.core[COR_CORE_ID()].schedsp, param.coroutine[id].sp);
+        assert_param(*(uint32_t *)((uint8_t *)param.coroutine[id].stack + COR_STACK_HEADER) == COR_STACK_GUARD);
+    }
+    else
+#endif
+    {
+        param.coroutine[id].callback(param.coroutine[id].arg);
+    }
+#if COR_ENABLE_STATS || COR_ENABLE_WATCHDOG
+    spent = COR_CYCLES() - start;
+#endif
+#if COR_ENABLE_WATCHDOG
+    // The slot is freed further down, so the handle still names this task in the hook
+    if (id != 0 && param.coroutine[id].budget != 0 && spent > param.coroutine[id].budget)
+    {
+        if (param.coroutine[id].hogs < 0xFFFF)
         {
-            param.coroutine[i].timeout = 0;
-            param.coroutine[i].bits.state = COR_READY;
+            param.coroutine[id].hogs += 1;
         }
+        COR_TRACE(COR_TRACE_HOG, id);
+        cor_watchdog_callback(COR_HANDLE(id), spent);
     }
-    param.tick = tick;
+#endif
+#if COR_ENABLE_STATS
+    param.coroutine[id].stats.runs += 1;
+    param.coroutine[id].stats.cycles += spent;
+    if (spent > param.coroutine[id].stats.max_cycles)
+    {
+        param.coroutine[id].stats.max_cycles = spent;
+    }
+#endif
+    COR_LOCK();
+    // The idle slice ends with the next dispatch
+    if (id != 0)
+    {
+        COR_TRACE(COR_TRACE_RETURN, id);
+    }
+#if COR_NUM_CORES > 1
+    // Off the core now, a task made ready meanwhile can finally be queued
+    param.coroutine[id].bits.oncpu = 0;
+    if (param.task.state[id] == COR_RUNNING || param.task.state[id] == COR_READY)
+#else
+    if (param.task.state[id] == COR_RUNNING)
+#endif
+    {
+        cor_set_state(id, COR_READY);
+    }
+    if (param.task.state[id] == COR_TERMINATED)
+    {
+        cor_free_slot(id);
+    }
+    COR_UNLOCK();
 }
-
-static void cor_dispatch(void)
+/**
+ * @brief Sleep while no task is ready.
+ * @param limit Longest sleep in milliseconds, COR_WAIT_FOREVER for none.
+ */
+static void cor_idle_sleep(uint32_t limit)
 {
-    uint8_t id = param.bits.currid;
-    uint8_t nextid = id;
-    uint8_t number = 0;
-    cor_process_time();
-    while (number++ < param.bits.cap)
+    uint32_t ms;
+    if (param.core[COR_CORE_ID()].readyprio != 0 || param.wakeup != 0)
+    {
+        return;
+    }
+    ms = cor_next_timeout();
+    if (ms > limit)
+    {
+        ms = limit;
+    }
+#if COR_USE_EPOLL
+    if (param.iowaiters > 0)
+    {
+        // Sleep in the kernel until a descriptor, a deadline or cor_wakeup ends the wait
+        cor_io_poll(ms == COR_WAIT_FOREVER ? -1 : (ms > 0x7FFFFFFF ? 0x7FFFFFFF : (int)ms));
+        return;
+    }
+#endif
+    if (ms != 0)
     {
-        nextid = cor_get_next_id(nextid);
-        if (nextid == 0)
+        cor_tickless_callback(ms);
+    }
+}
+/**
+ * @brief Ready the created tasks once, on whichever core or entry point gets here first.
+ */
+static void cor_start(void)
+{
+    COR_LOCK();
+    COR_CURRID = 0;
+    // With several cores, the first one to get here readies the tasks for all of them
+    if (!param.bits.started)
+    {
+        for (cor_id_t i = 0; i < param.cap; i++)
         {
-            continue;
+            if (param.task.state[i] != COR_NONE)
+                cor_set_state(i, COR_READY);
         }
-
-        if (param.coroutine[nextid].bits.state == COR_READY)
+        param.tick = cor_get_tick();
+        param.bits.started = 1;
+    }
+    COR_UNLOCK();
+}
+bool cor_run(void)
+{
+    if (param.bits.alreadyInit == 0)
+    {
+        return false;
+    }
+    cor_start();
+    for (;;)
+    {
+        cor_dispatch();
+        cor_exec();
+        if (COR_CURRID == 0)
         {
-            param.bits.currid = nextid;
-            return;
+#if COR_ENABLE_SIM
+            if (param.bits.sim)
+            {
+                if (!cor_sim_skip(NULL))
+                {
+                    return true;
+                }
+                continue;
+            }
+#endif
+            cor_idle_sleep(COR_WAIT_FOREVER);
         }
     }
-    param.bits.currid = 0;
+    return true;
 }
 
-static void cor_exec(void)
+bool cor_run_once(void)
 {
-
-    uint8_t id = param.bits.currid;
-    param.coroutine[id].bits.state = COR_RUNNING;
-    param.coroutine[id].callback(param.coroutine[id].arg);
-    if (param.coroutine[id].bits.state == COR_RUNNING)
+    if (param.bits.alreadyInit == 0)
     {
-        param.coroutine[id].bits.state = COR_READY;
+        return false;
     }
+    cor_start();
+    cor_dispatch();
+    cor_exec();
+    return COR_CURRID != 0;
 }
-bool cor_run(void)
+bool cor_run_for(cor_tick_t ticks)
 {
+    cor_tick_t end;
+    cor_tick_t remain;
+    uint64_t ms;
     if (param.bits.alreadyInit == 0)
     {
         return false;
     }
-    param.bits.currid = 0;
-    for (int i = 0; i < param.bits.cap; i++)
+    cor_start();
+    end = cor_get_tick() + ticks;
+    while (cor_time_before(cor_get_tick(), end))
+    {
+        cor_dispatch();
+        cor_exec();
+        if (COR_CURRID == 0)
+        {
+#if COR_ENABLE_SIM
+            if (param.bits.sim)
+            {
+                cor_sim_skip(&end);
+                continue;
+            }
+#endif
+            // Never past the end, even with no deadline to wake up for
+            remain = end - cor_get_tick();
+            ms = ((uint64_t)remain * 1000 + param.hz - 1) / param.hz;
+            cor_idle_sleep(ms < COR_WAIT_FOREVER ? (uint32_t)ms : COR_WAIT_FOREVER - 1);
+        }
+    }
+    return true;
+}
+uint32_t cor_run_until_idle(void)
+{
+    if (param.bits.alreadyInit == 0)
     {
-        if (param.coroutine[i].bits.state != COR_NONE)
-            param.coroutine[i].bits.state = COR_READY;
+        return COR_WAIT_FOREVER;
     }
-    param.tick = param.get_tick_1ms();
+    cor_start();
     for (;;)
     {
         cor_dispatch();
+        if (COR_CURRID == 0)
+        {
+            break;
+        }
         cor_exec();
     }
-    return true;
+    return cor_next_timeout();
 }
 
-__attribute__((weak)) void cor_idle_callback(void *arg)
+COR_WEAK void cor_idle_callback(void *arg)
 {
     // Idle task
 }
+
+COR_WEAK void cor_tickless_callback(uint32_t ms)
+{
+    // No low power mode by default, keep polling
+}
+
+COR_WEAK void cor_core_wakeup_callback(uint8_t core)
+{
+    // Cores poll, nothing to kick
+}
+#if COR_ENABLE_WATCHDOG
+COR_WEAK void cor_watchdog_callback(cor_handle_t handle, uint32_t cycles)
+{
+    // Counted and traced only, see cor_get_hogs
+}
+#endif
@@ -46,9 +46,444 @@
 #include "stdbool.h"
 #include "stdlib.h"
 #include "string.h"
+/**
+ * The board header (main.h of the vendor HAL) brings the stdint types and assert_param.
+ * Define COR_HOSTED to 1 to build without it, e.g. on a PC; compilers with
+ * __has_include pick hosted mode by themselves when no main.h is found.
+ */
+#ifndef COR_HOSTED
+#if defined(__has_include)
+#if !__has_include("main.h")
+#define COR_HOSTED (1)
+#endif
+#endif
+#endif
+#ifndef COR_HOSTED
+#define COR_HOSTED (0)
+#endif
+#if COR_HOSTED
+#include "stdint.h"
+#else
 #include "main.h"
-typedef uint8_t cor_handle_t;
-typedef uint32_t muxtex_handle_t;
+#endif
+#ifndef assert_param
+#include "assert.h"
+#define assert_param(expr) assert(expr)
+#endif
+
+/**
+ * Number of priority levels, 0 is the lowest. Tasks of a higher level always run first,
+ * tasks of the same level share the CPU round robin.
+ */
+#ifndef COR_PRIO_LEVELS
+#define COR_PRIO_LEVELS (4)
+#endif
+#if COR_PRIO_LEVELS < 1 || COR_PRIO_LEVELS > 32
+#error "COR_PRIO_LEVELS must be between 1 and 32"
+#endif
+/**
+ * Number of cores running cor_run. With more than one, the port defines
+ * COR_CORE_ID() to return the index of the calling core.
+ */
+#ifndef COR_NUM_CORES
+#define COR_NUM_CORES (1)
+#endif
+#if COR_NUM_CORES == 1 && !defined(COR_CORE_ID)
+#define COR_CORE_ID() (0)
+#endif
+#if COR_NUM_CORES > 1 && !defined(COR_CORE_ID)
+#error "COR_CORE_ID() must be defined when COR_NUM_CORES > 1"
+#endif
+/** Affinity of a task that may run on, and be stolen by, any core */
+#define COR_CORE_ANY (0xFF)
+/**
+ * Dispatch policy, fixed at build time so the dispatcher calls no hook. COR_SCHED_PRIO runs the
+ * highest ready level round robin. COR_SCHED_EDF runs, within the highest ready level, the task
+ * whose pending cor_periodic job has the earliest deadline, its next release. A job is pending
+ * from its release until that deadline. Tasks without a pending job, whether they never called
+ * cor_periodic or ran past the deadline, run round robin once no pending job of the level is
+ * ready. The EDF pick scans the ready tasks of that level.
+ */
+#define COR_SCHED_PRIO (0)
+#define COR_SCHED_EDF (1)
+#ifndef COR_SCHED_POLICY
+#define COR_SCHED_POLICY COR_SCHED_PRIO
+#endif
+#if COR_SCHED_POLICY != COR_SCHED_PRIO && COR_SCHED_POLICY != COR_SCHED_EDF
+#error "COR_SCHED_POLICY must be COR_SCHED_PRIO or COR_SCHED_EDF"
+#endif
+/** Priority of tasks created by cor_create_task */
+#ifndef COR_PRIO_DEFAULT
+#define COR_PRIO_DEFAULT (0)
+#endif
+
+/**
+ * Maximum number of tasks, the idle task included. The handle type and the
+ * scheduler tables are sized from it, so small builds stay small.
+ */
+#ifndef COROUTINE_MAX_SIZE
+#define COROUTINE_MAX_SIZE (32)
+#endif
+#if COROUTINE_MAX_SIZE < 2
+#error "COROUTINE_MAX_SIZE must leave room for the idle task"
+#endif
+/**
+ * cor_id_t indexes the task table. cor_handle_t is what the API hands out: the
+ * index in the low bits, the generation of the slot above it, so a handle kept
+ * after its task was deleted no longer matches once the slot is reused.
+ */
+#if COROUTINE_MAX_SIZE <= 0xFF
+typedef uint8_t cor_id_t;
+typedef uint16_t cor_handle_t;
+#elif COROUTINE_MAX_SIZE <= 0xFFFF
+typedef uint16_t cor_id_t;
+typedef uint32_t cor_handle_t;
+#else
+typedef uint32_t cor_id_t;
+typedef uint64_t cor_handle_t;
+#endif
+#define COR_ID_BITS (8 * sizeof(cor_id_t))
+/**
+ * Set to 1 for 64 bit ticks. 32 bit deadlines are compared wrap-safe, which
+ * limits a single wait to half the counter range (35 minutes at 1 MHz).
+ */
+#ifndef COR_TICK_64BIT
+#define COR_TICK_64BIT (0)
+#endif
+#if COR_TICK_64BIT
+typedef uint64_t cor_tick_t;
+typedef int64_t cor_stick_t;
+#else
+typedef uint32_t cor_tick_t;
+typedef int32_t cor_stick_t;
+#endif
+/**
+ * Set to 0 to keep the heap out of the library entirely, cor_init then uses a
+ * table of COROUTINE_MAX_SIZE tasks placed by the linker.
+ */
+#ifndef COR_USE_MALLOC
+#define COR_USE_MALLOC (1)
+#endif
+/**
+ * Set to 1 to count runs and cycles per task, see cor_stats_get, and to keep the
+ * peak occupancy of every channel and SPSC ring in its peak field. COR_CYCLES()
+ * defaults to DWT->CYCCNT on Cortex-M3 and up (the port enables the counter),
+ * the TSC on x86 and CLOCK_MONOTONIC nanoseconds on other hosted targets.
+ */
+#ifndef COR_ENABLE_STATS
+#define COR_ENABLE_STATS (0)
+#endif
+/**
+ * Set to 1 to time every callback invocation against the budget of its task, see cor_set_budget.
+ * A run over budget is counted, traced as COR_TRACE_HOG and reported to cor_watchdog_callback.
+ * COR_WATCHDOG_BUDGET is the budget of new tasks in COR_CYCLES() units, 0 leaves them unwatched.
+ */
+#ifndef COR_ENABLE_WATCHDOG
+#define COR_ENABLE_WATCHDOG (0)
+#endif
+#ifndef COR_WATCHDOG_BUDGET
+#define COR_WATCHDOG_BUDGET (0)
+#endif
+/**
+ * Set to 1 for host simulation, see cor_sim_start: the tick is a virtual clock that stands still
+ * while tasks run and jumps to the next deadline whenever no task is ready. With the same seed
+ * and the same order of task creation every run schedules alike. Single core only.
+ */
+#ifndef COR_ENABLE_SIM
+#define COR_ENABLE_SIM (0)
+#endif
+#if COR_ENABLE_SIM && COR_NUM_CORES > 1
+#error "COR_ENABLE_SIM needs COR_NUM_CORES == 1"
+#endif
+/**
+ * Set to 1 to run several independent schedulers in one program, see cor_sched_create.
+ * The API takes no instance argument: each thread works on the instance it selected with
+ * cor_sched_use, the default one until then. Every kernel access then goes through that
+ * pointer, a thread-local load on hosted builds and a plain global one on bare metal,
+ * where COR_THREAD_LOCAL defaults to nothing. Bare metal builds with COR_NUM_CORES > 1
+ * (up to 4) keep one selection per core instead, indexed by COR_CORE_ID(), so a core
+ * switching instances leaves the others alone. Interrupt handlers have no instance of their
+ * own; they use the cor_sched_*_from_isr entry points, which name the instance. With 0 the
+ * state is one static instance and no pointer is involved.
+ */
+#ifndef COR_ENABLE_INSTANCES
+#define COR_ENABLE_INSTANCES (0)
+#endif
+#ifndef COR_THREAD_LOCAL
+#if !COR_HOSTED
+#define COR_THREAD_LOCAL
+#elif defined(__cplusplus)
+#define COR_THREAD_LOCAL thread_local
+#elif defined(__GNUC__)
+#define COR_THREAD_LOCAL __thread
+#else
+#define COR_THREAD_LOCAL _Thread_local
+#endif
+#endif
+/* Compile time check, the keyword differs between C11 and C++11 */
+#ifdef __cplusplus
+#define COR_STATIC_ASSERT(cond, msg) static_assert(cond, msg)
+#else
+#define COR_STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+#endif
+/**
+ * Scheduler events kept in the trace ring, a power of two, 0 compiles tracing out.
+ * Each event costs 8 bytes; the oldest is overwritten. COR_TRACE_TIME() stamps the
+ * events and defaults to cor_get_tick(), define COR_TRACE_HZ along with it.
+ */
+#ifndef COR_TRACE_SIZE
+#define COR_TRACE_SIZE (0)
+#endif
+#if (COR_TRACE_SIZE & (COR_TRACE_SIZE - 1)) != 0
+#error "COR_TRACE_SIZE must be a power of two"
+#endif
+/**
+ * Set to 1 on Linux to let tasks wait for file descriptors, see cor_await_fd.
+ * While any task waits on one, the idle path sleeps in epoll_wait instead of cor_tickless_callback.
+ */
+#ifndef COR_USE_EPOLL
+#define COR_USE_EPOLL (0)
+#endif
+#if COR_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+/**
+ * Deepest nesting of child coroutines, a child called by a task is at depth 1.
+ * Every level keeps one C stack frame while the chain runs, see COR_CHILD_DEPTH.
+ */
+#ifndef COR_CHILD_MAX_DEPTH
+#define COR_CHILD_MAX_DEPTH (4)
+#endif
+/**
+ * Set to 1 to resume tasks through a switch on the line number (Duff's device) instead of
+ * the labels-as-values extension of GCC and clang, for strict C compilers. A task then ends
+ * with COR_END() and a child routine with COR_CHILD_END(), and a switch statement of the
+ * task itself must not span a wait. Other compilers than GCC and clang get it by default.
+ * The rest of the kernel goes through the compiler primitives at the top of coroutine.c
+ * (COR_CTZ, COR_WEAK, COR_ATOMIC_*, ...), which fall back to portable C and CMSIS
+ * intrinsics; only the stackful backend needs GNU assembly.
+ */
+#ifndef COR_USE_SWITCH
+#if defined(__GNUC__)
+#define COR_USE_SWITCH (0)
+#else
+#define COR_USE_SWITCH (1)
+#endif
+#endif
+/**
+ * Set to 1 to let tasks run on a stack of their own, see cor_create_stackful_task.
+ * The stacks are carved from a static pool of COR_STACK_POOL_SIZE bytes. The context
+ * switch is written for x86-64 (System V) and for Thumb-2 cores, Cortex-M3 and up.
+ */
+#ifndef COR_ENABLE_STACKFUL
+#define COR_ENABLE_STACKFUL (0)
+#endif
+#if COR_ENABLE_STACKFUL && !defined(__GNUC__)
+#error "COR_ENABLE_STACKFUL needs GCC or clang, its context switch is GNU assembly"
+#endif
+#ifndef COR_STACK_POOL_SIZE
+#define COR_STACK_POOL_SIZE (4096)
+#endif
+/**
+ * Bytes of the pool behind cor_pool_alloc on each core, 0 compiles it out. Blocks come in
+ * COR_POOL_CLASSES power-of-two size classes of 16 bytes and up. A freed block goes back to
+ * the freelist of its class on the core that carved it, so no core ever locks another.
+ */
+#ifndef COR_POOL_SIZE
+#define COR_POOL_SIZE (0)
+#endif
+#ifndef COR_POOL_CLASSES
+#define COR_POOL_CLASSES (6) /* 16 to 512 bytes */
+#endif
+/**
+ * Atomic primitives for the interrupt notification path, together with COR_ATOMIC_LOAD,
+ * COR_ATOMIC_STORE, COR_ATOMIC_CAS and COR_FENCE, see coroutine.c. With GCC and clang the
+ * defaults compile to LDREX/STREX on Cortex-M3 and up; on cores without them (Cortex-M0)
+ * define COR_ATOMIC_OR and COR_ATOMIC_XCHG with interrupts masked.
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Scheduler instance: its tasks, ready sets, sleep queue and pools, see COR_ENABLE_INSTANCES.
+ */
+typedef struct cor_sched cor_sched_t;
+
+#if COR_ENABLE_STATS
+/**
+ * @brief Runtime counters of one task, in COR_CYCLES() units.
+ */
+typedef struct
+{
+    uint32_t runs;        /* Callback invocations */
+    uint64_t cycles;      /* Total time inside the callback */
+    uint32_t max_cycles;  /* Longest single invocation */
+    uint32_t max_latency; /* Longest time from COR_READY to COR_RUNNING */
+} cor_stats_t;
+#endif
+
+/**
+ * @brief RAM taken by the scheduler, see cor_footprint_get.
+ */
+typedef struct
+{
+    uint32_t kernel;     /* Static scheduler state: ready sets, sleep queue, per-task arrays, trace ring */
+    uint32_t table;      /* Task table, the idle task included */
+    uint16_t entry;      /* Bytes of one task table entry */
+    uint16_t cap;        /* Tasks the table holds, besides the idle task */
+    uint16_t used;       /* Most task slots ever in use at once, besides the idle task */
+    uint32_t stack_pool; /* COR_STACK_POOL_SIZE, 0 without the stackful backend */
+    uint32_t stack_used; /* Pool bytes carved out for stacks so far */
+    uint32_t pool;       /* COR_POOL_SIZE times the cores, 0 without the block pool */
+    uint32_t pool_used;  /* Bytes carved out of the block pools so far, all cores together */
+} cor_footprint_t;
+
+#if COR_TRACE_SIZE > 0
+#define COR_TRACE_MAGIC 0x54524F43u /* "CORT" */
+#define COR_TRACE_VERSION 1
+#endif
+typedef enum
+{
+    COR_TRACE_DISPATCH = 1, /* Task picked to run, task 0 is the idle task, once per idle stretch */
+    COR_TRACE_RETURN,       /* Task returned from its callback, never recorded for the idle task */
+    COR_TRACE_YIELD,
+    COR_TRACE_SLEEP,
+    COR_TRACE_SUSPEND,
+    COR_TRACE_RESUME,
+    COR_TRACE_BLOCK_MUTEX,
+    COR_TRACE_BLOCK_SEM,
+    COR_TRACE_BLOCK_EVENT,
+    COR_TRACE_BLOCK_CHAN,
+    COR_TRACE_BLOCK_NOTIFY,
+    COR_TRACE_WAKE,    /* Blocked task woken by the object it waited on */
+    COR_TRACE_TIMEOUT, /* Sleep or timed wait ran out */
+    COR_TRACE_BLOCK_IO,
+    COR_TRACE_HOG, /* Callback ran over the budget of its task */
+} cor_trace_type_t;
+#if COR_TRACE_SIZE > 0
+/**
+ * @brief One trace record, as stored and as exported.
+ */
+typedef struct
+{
+    uint32_t time;
+    uint16_t task;
+    uint8_t event; /* cor_trace_type_t */
+    uint8_t core;
+} cor_trace_event_t;
+/**
+ * @brief Header in front of the records written by cor_trace_export, little endian on the usual targets.
+ */
+typedef struct
+{
+    uint32_t magic; /* COR_TRACE_MAGIC */
+    uint16_t version;
+    uint16_t size;    /* sizeof(cor_trace_event_t) */
+    uint32_t hz;      /* Rate of the time stamps */
+    uint32_t count;   /* Records that follow, oldest first */
+    uint32_t dropped; /* Older records already overwritten */
+} cor_trace_header_t;
+#endif
+
+/**
+ * @brief Queue of tasks waiting on an object, linked through the task table.
+ * @note The idle task never waits, so id 0 marks the end of the queue.
+ */
+typedef struct
+{
+    cor_id_t head;
+    cor_id_t tail;
+} cor_waitq_t;
+typedef struct
+{
+    cor_id_t owner; /* Owning task id + 1, 0 if unlocked */
+    cor_waitq_t waiters;
+} cor_mutex_t;
+typedef cor_mutex_t muxtex_handle_t;
+#define COR_MUTEX_INIT {0}
+typedef struct
+{
+    uint32_t count;
+    cor_waitq_t waiters;
+} cor_sem_t;
+#define COR_SEM_INIT(count) {(count), {0}}
+typedef struct
+{
+    uint32_t flags;
+    cor_waitq_t waiters;
+} cor_event_t;
+#define COR_EVENT_INIT {0}
+#define COR_GROUP_WORDS ((COROUTINE_MAX_SIZE + 31) / 32)
+/**
+ * @brief Set of tasks resumed or suspended together, bit n stands for task slot n.
+ * @note It holds slots, not handles: take a task out of its groups before deleting it.
+ */
+typedef struct
+{
+    uint32_t mask[COR_GROUP_WORDS];
+} cor_group_t;
+#define COR_GROUP_INIT {{0}}
+/**
+ * @brief Channel passing pointers between tasks, the buffers themselves are never copied.
+ * @note With size 0 the channel is a rendezvous: a send waits for a receiver.
+ */
+typedef struct
+{
+    void **buf;
+    uint32_t size;
+    uint32_t head; /* Oldest message */
+    uint32_t count;
+    cor_waitq_t senders;
+    cor_waitq_t receivers;
+#if COR_ENABLE_STATS
+    uint32_t peak; /* Most messages ever buffered at once */
+#endif
+} cor_chan_t;
+#define COR_CHAN_INIT(buf, size) {(buf), (size), 0, 0, {0}, {0}}
+/**
+ * @brief Lock free single producer / single consumer ring of pointers.
+ * @note Either side may be an interrupt. size must be a power of two.
+ */
+typedef struct
+{
+    void **buf;
+    uint32_t size;
+    volatile uint32_t head;         /* Written by the producer only */
+    volatile uint32_t tail;         /* Written by the consumer only */
+    volatile cor_handle_t consumer; /* Handle of the task blocked in cor_spsc_recv, 0 if none */
+#if COR_ENABLE_STATS
+    uint32_t peak; /* Most messages ever queued at once, as seen by the producer */
+#endif
+} cor_spsc_t;
+#define COR_SPSC_INIT(buf, size) {(buf), (size), 0, 0, 0}
+/* Event wait modes, can be combined */
+#define COR_EVENT_ANY (0)   /* Wake when any of the flags is set */
+#define COR_EVENT_ALL (1)   /* Wake when all of the flags are set */
+#define COR_EVENT_CLEAR (2) /* Clear the matched flags on wake-up */
+/**
+ * @brief Completion of an operation finished by an interrupt, e.g. a DMA transfer.
+ * @note One task waits on it at a time. A completion signalled before the wait is kept and consumed by the wait.
+ */
+typedef struct
+{
+    volatile uint8_t done;
+    volatile cor_id_t waiter; /* Id + 1 of the waiting task, 0 if none */
+} cor_completion_t;
+#define COR_COMPLETION_INIT {0, 0}
+
+/**
+ * @brief Resume state of one child coroutine instance, first member of the context its caller provides.
+ * @note The context outlives the call, so the child keeps its own variables in it across waits.
+ */
+typedef struct
+{
+    void *label;  /* Resume point inside the child, NULL while not waiting */
+    void *resume; /* Resume point of the task, the call site in the task that started the chain */
+} cor_child_t;
+
 typedef enum
 {
     COR_NONE = 0,
@@ -58,6 +493,7 @@ typedef enum
     COR_BLOCKED,
     COR_WAITING,
     COR_SUSPEND,
+    COR_IOWAIT, /* Waiting for a file descriptor or a completion */
     COR_TERMINATED
 } cor_state_t;
 typedef enum
@@ -71,23 +507,80 @@ typedef struct
     void (*callback)(void *arg);
     void *arg;
     void *label;
-    uint32_t timeout;
+    cor_id_t next;      /* Next task in the same wait queue, or in the free list */
+    cor_id_t gen;       /* Generation, bumped each time the slot is freed */
+#if COR_ENABLE_WATCHDOG
+    uint16_t hogs;   /* Runs over budget, saturates */
+    uint32_t budget; /* Longest run allowed in COR_CYCLES() units, 0 if unwatched */
+#endif
+#if COR_ENABLE_STATS
+    uint32_t readyat; /* COR_CYCLES() when the task last became ready */
+    cor_stats_t stats;
+#endif
+#if COR_ENABLE_STACKFUL
+    void *sp;    /* Saved stack pointer of a stackful task while off the CPU */
+    void *stack; /* Pool block holding the stack of a stackful task */
+#endif
+    uint8_t affinity; /* Pinned core, COR_CORE_ANY if any core may run it */
     struct
     {
-        cor_state_t state : 4;
         uint8_t swstate : 1;
+        uint8_t insleep : 1;  /* In the sleep queue, waiting or blocked with a timeout */
+        uint8_t waitmode : 2; /* COR_EVENT_* mode of an event wait */
+        uint8_t notified : 1; /* Notification latched while not waiting for it */
+        uint8_t oncpu : 1;    /* Inside its callback on some core */
+        uint8_t periodic : 1; /* release holds a valid anchor */
+        uint8_t stackful : 1; /* Runs on its own stack, see cor_create_stackful_task */
 
     } bits;
 } Coroutine_t;
 
+#define COR_WAIT_FOREVER (0xFFFFFFFFu)
+
 void cor_idle_callback(void *arg);
+/**
+ * @brief Tickless idle hook, called by cor_run when no task is ready.
+ * @param ms Time until the next task deadline, COR_WAIT_FOREVER if no task is sleeping.
+ * @note The port may stop the CPU for up to ms (WFI, stop mode, timer compare) and must advance the tick across it.
+ *       cor_next_deadline gives the same point as an absolute tick, for a timer compare.
+ *       To not lose a wake-up, mask interrupts, check cor_wakeup_pending(), then sleep.
+ */
+void cor_tickless_callback(uint32_t ms);
+#if COR_ENABLE_WATCHDOG
+/**
+ * @brief Called when a callback returns after running over the budget of its task.
+ * @param handle Task handle, the task may be suspended or deleted from here.
+ * @param cycles Length of the run in COR_CYCLES() units.
+ */
+void cor_watchdog_callback(cor_handle_t handle, uint32_t cycles);
+#endif
+/**
+ * @brief Called when a task becomes ready on another core than the caller's.
+ * @param core Core index, the port may send it an event or interrupt to end its idle sleep.
+ */
+void cor_core_wakeup_callback(uint8_t core);
 void *cor_begin(void *label);
 
 /**
  * @brief Pause the execution of the coroutine and yield the CPU.
  * @param label Coroutine execution label.
+ * @param state COR_READY to yield, COR_WAITING to sleep.
+ * @param timeout Ticks to sleep for.
+ */
+void yield(void *label, cor_state_t state, cor_tick_t timeout);
+/**
+ * @brief Sleep until an absolute tick.
+ * @param label Coroutine execution label.
+ * @param deadline Tick to wake up at, a deadline already past only yields.
+ */
+void sleep_until(void *label, cor_tick_t deadline);
+/**
+ * @brief Sleep until the next release of a fixed-rate loop.
+ * @param label Coroutine execution label.
+ * @param period Ticks between releases.
+ * @note The first call anchors the loop at the tick the task was dispatched at. Releases already missed are skipped and counted as overruns.
  */
-void yield(void *label, cor_state_t state, uint32_t timeout);
+void periodic(void *label, cor_tick_t period);
 /**
  * @brief Suspend the specified coroutine.
  * @param handle Pointer to the coroutine handle. If NULL, suspends the current coroutine.
@@ -96,6 +589,7 @@ void suspend(cor_handle_t *handle);
 /**
  * @brief Resume the execution of the specified coroutine.
  * @param handle Pointer to the coroutine handle.
+ * @note A task blocked on a mutex is left alone by suspend and resume, it wakes when the mutex is handed to it.
  */
 
 #define JOINT(x, y) x##y
@@ -103,15 +597,129 @@ void suspend(cor_handle_t *handle);
 #define UNIQUE_LABEL CONCAT(label_, __LINE__)
 #define UNIQUE_VAR CONCAT(var_, __LINE__)
 
+/* COR_LABEL is the resume point that COR_MARK() places on the same line */
+#if COR_USE_SWITCH
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define COR_FALLTHROUGH __attribute__((fallthrough));
+#else
+#define COR_FALLTHROUGH
+#endif
+#define COR_LABEL ((void *)(uintptr_t)__LINE__)
+#define COR_MARK()  \
+    COR_FALLTHROUGH \
+    case __LINE__:
+#else
+#define COR_LABEL (&&UNIQUE_LABEL)
+#define COR_MARK() \
+    UNIQUE_LABEL:
+#endif
+
 #define RESUMESTATE() \
-    UNIQUE_LABEL:     \
+    COR_MARK()        \
     cor_set_sw_state(SW_NORMAL)
 
 bool cor_run(void);
 void resume(cor_handle_t *handle);
 void cor_set_sw_state(switch_state_t state);
-void mutex_lock(muxtex_handle_t *handle);
+/**
+ * @brief Take the mutex, or queue the current task on it.
+ * @param label Coroutine execution label to resume at once the mutex is handed over.
+ * @param handle Mutex.
+ * @return true if the mutex was taken, false if the task has to give up the CPU.
+ */
+bool mutex_lock(void *label, muxtex_handle_t *handle);
 void mutex_unlock(muxtex_handle_t *handle);
+/**
+ * @brief Take the semaphore, or queue the current task on it.
+ * @param label Coroutine execution label to resume at once the semaphore is given.
+ * @param sem Semaphore.
+ * @param timeout Milliseconds to wait, 0 to only try, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the semaphore was taken or the try failed, false if the task has to give up the CPU.
+ */
+bool sem_take(void *label, cor_sem_t *sem, uint32_t timeout);
+/**
+ * @brief Wait for event flags, or queue the current task on the group.
+ * @param label Coroutine execution label to resume at once the flags are set.
+ * @param event Event flag group.
+ * @param mask Flags to wait for.
+ * @param mode COR_EVENT_* mode.
+ * @param timeout Milliseconds to wait, 0 to only try, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the wait is already over, false if the task has to give up the CPU.
+ */
+bool event_wait(void *label, cor_event_t *event, uint32_t mask, uint8_t mode, uint32_t timeout);
+/**
+ * @brief Wait for a notification, consumes a latched one right away.
+ * @param label Coroutine execution label to resume at once notified.
+ * @param timeout Milliseconds to wait, 0 to only try, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the wait is already over, false if the task has to give up the CPU.
+ */
+bool notify_wait(void *label, uint32_t timeout);
+/**
+ * @brief Send a message on a channel, or queue the current task until there is room.
+ * @param label Coroutine execution label to resume at once the message is taken.
+ * @param chan Channel.
+ * @param msg Message.
+ * @param timeout Milliseconds to wait, 0 to only try, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the send is already over, false if the task has to give up the CPU.
+ */
+bool chan_send(void *label, cor_chan_t *chan, void *msg, uint32_t timeout);
+/**
+ * @brief Receive a message from a channel, or queue the current task until one arrives.
+ * @param label Coroutine execution label to resume at once a message is handed over.
+ * @param chan Channel.
+ * @param timeout Milliseconds to wait, 0 to only try, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the receive is already over, false if the task has to give up the CPU.
+ */
+bool chan_recv(void *label, cor_chan_t *chan, uint32_t timeout);
+/**
+ * @brief Receive from a ring, or wait for the producer's notification.
+ * @param label Coroutine execution label to retry at.
+ * @param spsc Ring.
+ * @return true if a message was taken, false if the task has to give up the CPU.
+ */
+bool spsc_recv(void *label, cor_spsc_t *spsc);
+/**
+ * @brief Delete the current task, it must return right after, see cor_task_exit.
+ */
+void task_exit(void);
+/**
+ * @brief Wait for a completion, consumes an already signalled one right away.
+ * @param label Coroutine execution label to resume at once completed.
+ * @param completion Completion.
+ * @param timeout Milliseconds to wait, 0 to only try, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the wait is already over, false if the task has to give up the CPU.
+ */
+bool await_completion(void *label, cor_completion_t *completion, uint32_t timeout);
+#if COR_USE_EPOLL
+/**
+ * @brief Wait until a file descriptor is ready.
+ * @param label Coroutine execution label to resume at once ready.
+ * @param fd File descriptor, non-blocking.
+ * @param events EPOLLIN, EPOLLOUT, ...
+ * @param timeout Milliseconds to wait, COR_WAIT_FOREVER to wait without limit.
+ * @return true if the wait is already over (epoll refused the descriptor, or another task waits on it and errno is
+ *         EBUSY), false if the task has to give up the CPU.
+ * @note One task at a time may wait on a descriptor.
+ */
+bool await_fd(void *label, int fd, uint32_t events, uint32_t timeout);
+#endif
+/**
+ * @brief Get the message of the last channel operation of the current task.
+ * @return Message, NULL if nothing was received.
+ */
+void *cor_wait_msg(void);
+/**
+ * @brief Get the result of the last wait of the current task.
+ * @return For a semaphore, notification, completion or channel 1 if done, for an event the matched flags,
+ *         for a file descriptor the epoll events, 0 on timeout.
+ */
+uint32_t cor_wait_result(void);
+#if COR_ENABLE_STACKFUL
+/**
+ * @brief Leave the stack of the current stackful task for the scheduler, returns once the task is dispatched again.
+ */
+void cor_stack_switch(void);
+#endif
 
 /*------The following is the exported user api. Please do not call the functions above this location.------*/
 
@@ -121,11 +729,81 @@ void mutex_unlock(muxtex_handle_t *handle);
  * @param get_tick_1ms Get tick
  * @return true if success
  */
-bool cor_init(uint8_t cap, uint32_t (*get_tick_1ms)(void));
+bool cor_init(cor_id_t cap, uint32_t (*get_tick_1ms)(void));
+/**
+ * @brief Initialize coroutine on a caller owned task table, nothing is allocated
+ * @param table Task table with room for cap + 1 tasks, see COR_STATIC_TABLE
+ * @param cap Number of tasks
+ * @param get_tick_1ms Get tick
+ * @return true if success
+ */
+bool cor_init_static(Coroutine_t *table, cor_id_t cap, uint32_t (*get_tick_1ms)(void));
+/**
+ * @brief Declare a task table for cor_init_static, one entry is reserved for the idle task
+ * @param name Table name
+ * @param cap Number of tasks
+ */
+#define COR_STATIC_TABLE(name, cap) static Coroutine_t name[(cap) + 1]
 /**
  * @brief Deinitialize coroutine
  */
 void cor_deinit(void);
+#if COR_ENABLE_INSTANCES
+/**
+ * @brief Select the scheduler the calling thread works on, or the calling core on bare metal, from then on every call goes to it
+ * @param sched Instance, NULL for the default one
+ * @return Instance selected before
+ * @note Handles belong to the instance that created them. Not for interrupt handlers, they use
+ *       the cor_sched_*_from_isr entry points.
+ */
+cor_sched_t *cor_sched_use(cor_sched_t *sched);
+/**
+ * @brief cor_notify_from_isr on a given instance, whatever the interrupted code has selected
+ * @param sched Instance, NULL for the default one
+ * @param handle Task handle of that instance
+ */
+void cor_sched_notify_from_isr(cor_sched_t *sched, cor_handle_t *handle);
+/**
+ * @brief cor_complete_from_isr on a given instance, whatever the interrupted code has selected
+ * @param sched Instance, NULL for the default one
+ * @param completion Completion waited on by a task of that instance
+ */
+void cor_sched_complete_from_isr(cor_sched_t *sched, cor_completion_t *completion);
+/**
+ * @brief cor_wakeup on a given instance, from an interrupt or another thread
+ * @param sched Instance, NULL for the default one
+ */
+void cor_sched_wakeup(cor_sched_t *sched);
+/**
+ * @brief Get the scheduler the calling thread works on
+ * @return Instance
+ */
+cor_sched_t *cor_sched_self(void);
+/**
+ * @brief Bytes a scheduler instance takes, for cor_sched_create_static
+ */
+size_t cor_sched_size(void);
+/**
+ * @brief Set up a scheduler instance in caller owned memory, select it and cor_init it before use
+ * @param mem At least cor_sched_size() bytes, 16 byte aligned when the stack or block pool is enabled
+ * @param len Bytes at mem
+ * @return Instance, NULL if mem is too small
+ */
+cor_sched_t *cor_sched_create_static(void *mem, size_t len);
+#if COR_USE_MALLOC
+/**
+ * @brief Allocate a scheduler instance, select it and cor_init it before use
+ * @return Instance, NULL if out of memory
+ */
+cor_sched_t *cor_sched_create(void);
+#endif
+/**
+ * @brief Deinitialize a scheduler instance and free it if cor_sched_create allocated it
+ * @param sched Instance, not the default one and not selected on any other thread
+ * @note A calling thread that had it selected falls back to the default instance.
+ */
+void cor_sched_destroy(cor_sched_t *sched);
+#endif
 /**
  * @brief Create a task
  * @param handle Task handle
@@ -134,16 +812,251 @@ void cor_deinit(void);
  * @return true if success
  */
 bool cor_create_task(cor_handle_t *handle, void (*callback)(void *arg), void *arg);
+/**
+ * @brief Create a task with a priority
+ * @param handle Task handle
+ * @param callback Task callback
+ * @param arg Task argument
+ * @param prio Priority, 0 (lowest) to COR_PRIO_LEVELS - 1
+ * @return true if success
+ */
+bool cor_create_task_ex(cor_handle_t *handle, void (*callback)(void *arg), void *arg, uint8_t prio);
+#if COR_POOL_SIZE > 0
+/**
+ * @brief Create a task whose argument is a zeroed context of its own, taken from the block pool
+ * @param handle Task handle
+ * @param callback Task callback, called with the context
+ * @param size Context bytes
+ * @param prio Priority, 0 (lowest) to COR_PRIO_LEVELS - 1
+ * @param ctx Receives the context before the task can run, may be NULL
+ * @return false if the pool or the task table is exhausted
+ * @note The context goes back to the pool once the task is deleted, contexts of the same
+ *       task type are recycled from the freelist of their size class.
+ */
+bool cor_create_task_ctx(cor_handle_t *handle, void (*callback)(void *arg), uint32_t size, uint8_t prio, void **ctx);
+/**
+ * @brief Take a block from the pool of the calling core
+ * @param size Bytes, at most 16 << (COR_POOL_CLASSES - 1)
+ * @return Block aligned for any type, NULL if the size is too large or the pool exhausted
+ * @note Not from interrupts. Blocks of a size class are only ever reused for that class.
+ */
+void *cor_pool_alloc(size_t size);
+/**
+ * @brief Give a block back, from any core and with any instance selected
+ * @param ptr Block from cor_pool_alloc, NULL is ignored
+ * @note The block goes back to the pool of the core and instance that carved it.
+ */
+void cor_pool_free(void *ptr);
+#endif
+#if COR_ENABLE_STACKFUL
+/**
+ * @brief Create a task that runs on a stack of its own, so its locals survive every wait
+ * @param handle Task handle
+ * @param entry Task body, called once; returning from it ends the task
+ * @param arg Task argument
+ * @param prio Priority, 0 (lowest) to COR_PRIO_LEVELS - 1
+ * @param stack_size Stack bytes, rounded up to 16, taken from the pool of COR_STACK_POOL_SIZE bytes
+ * @return false if the pool or the task table is exhausted
+ * @note The task waits with the cor_stack_* calls below, from any function depth; the cor_ wait macros
+ *       do not work in it. The stack goes back to the pool when the task is deleted.
+ */
+bool cor_create_stackful_task(cor_handle_t *handle, void (*entry)(void *arg), void *arg, uint8_t prio, uint32_t stack_size);
+/**
+ * @brief Get the deepest use of the stack of a stackful task so far
+ * @param handle Task handle, NULL for the current task
+ * @return Bytes, found by looking for the paint laid down at creation; 0 for a stackless task or a stale handle
+ */
+uint32_t cor_stack_high_water(cor_handle_t *handle);
+#endif
+/**
+ * @brief Delete a task and free its slot for a later cor_create_task
+ * @param handle Task handle
+ * @return false if the handle is stale or names the idle task
+ * @note The task is taken off every queue it waits on; a mutex it holds stays locked. Its handles
+ *       become stale at once. A task deleting itself keeps running until its callback returns.
+ */
+bool cor_delete_task(cor_handle_t *handle);
+/**
+ * @brief Pin a task to a core, or let any core run it
+ * @param handle Task handle
+ * @param core Core index, COR_CORE_ANY to unpin
+ * @return true if success
+ * @note Tasks start unpinned, spread over the cores. Each core calls cor_run, an idle core steals unpinned ready tasks.
+ */
+bool cor_set_affinity(cor_handle_t *handle, uint8_t core);
+/**
+ * @brief Run one scheduling step: dispatch and run the next ready task, or the idle task if none is
+ * @return true if a task other than the idle task ran
+ * @note For embedding in an existing loop. The first call readies the created tasks, as cor_run does.
+ */
+bool cor_run_once(void);
+/**
+ * @brief Keep scheduling for a number of ticks, then return
+ * @param ticks Ticks of the active tick source
+ * @return false if the library is not initialized
+ * @note The check happens between task runs, a long task or the tickless hook may overrun the end.
+ */
+bool cor_run_for(cor_tick_t ticks);
+/**
+ * @brief Run ready tasks until none is left, without running the idle task
+ * @return Milliseconds until the next sleeping task is due, COR_WAIT_FOREVER if none, e.g. the timeout of poll or epoll_wait
+ */
+uint32_t cor_run_until_idle(void);
+/**
+ * @brief Replace the 1 ms tick with a faster or wider one, call before cor_run
+ * @param get_tick Free running tick counter
+ * @param ticks_per_sec Tick rate, e.g. 1000000 for a microsecond timer
+ * @return true if success
+ */
+bool cor_set_tick_source(cor_tick_t (*get_tick)(void), uint32_t ticks_per_sec);
+#if COR_ENABLE_SIM
+/**
+ * @brief Replace the tick with a virtual clock starting at 0, call after cor_init and before cor_run
+ * @param ticks_per_sec Rate of the virtual clock, 1000 for millisecond ticks
+ * @param seed Seed of cor_sim_random, 0 picks a fixed one
+ * @return true if success
+ * @note Once no task is ready or sleeping cor_run returns true, the simulation has run out of events.
+ */
+bool cor_sim_start(uint32_t ticks_per_sec, uint32_t seed);
+/**
+ * @brief Move the virtual clock forward, for a task to account for the time its work would take
+ * @param ticks Ticks to add
+ */
+void cor_sim_advance(cor_tick_t ticks);
+/**
+ * @brief Next number of a pseudo random sequence fixed by the seed of cor_sim_start
+ * @return Random number, never 0
+ */
+uint32_t cor_sim_random(void);
+#endif
+/**
+ * @brief Get the current tick
+ * @return Tick of the active tick source
+ */
+cor_tick_t cor_get_tick(void);
+/**
+ * @brief Convert milliseconds to ticks, rounded up
+ */
+cor_tick_t cor_ms_to_ticks(uint32_t ms);
+/**
+ * @brief Convert microseconds to ticks, rounded up
+ */
+cor_tick_t cor_us_to_ticks(uint32_t us);
+/**
+ * @brief Get the number of periodic releases a task has missed
+ * @param handle Task handle, NULL for the calling task
+ * @param clear Reset the counter after reading it
+ * @return Overrun count, saturates at 0xFFFF
+ */
+uint16_t cor_get_overruns(cor_handle_t *handle, bool clear);
+/**
+ * @brief Get the RAM taken by the scheduler and how much of it was needed so far
+ * @param out Receives the footprint
+ * @note used tells how far COROUTINE_MAX_SIZE or the cap of cor_init can shrink, stack_used
+ *       how far COR_STACK_POOL_SIZE can, along with cor_stack_high_water per task.
+ */
+void cor_footprint_get(cor_footprint_t *out);
+#if COR_ENABLE_STATS
+/**
+ * @brief Get the runtime counters of a task
+ * @param handle Task handle
+ * @param out Receives the counters
+ * @return true if success
+ */
+bool cor_stats_get(cor_handle_t *handle, cor_stats_t *out);
+/**
+ * @brief Zero the runtime counters of a task
+ * @param handle Task handle
+ */
+void cor_stats_reset(cor_handle_t *handle);
+#endif
+#if COR_ENABLE_WATCHDOG
+/**
+ * @brief Set the longest time one run of a task's callback may take
+ * @param handle Task handle, NULL for the calling task
+ * @param cycles Budget in COR_CYCLES() units, 0 stops watching the task
+ * @return true if success
+ */
+bool cor_set_budget(cor_handle_t *handle, uint32_t cycles);
+/**
+ * @brief Get the number of runs of a task that went over its budget
+ * @param handle Task handle, NULL for the calling task
+ * @param clear Reset the counter after reading it
+ * @return Hog count, saturates at 0xFFFF
+ */
+uint16_t cor_get_hogs(cor_handle_t *handle, bool clear);
+#endif
+/**
+ * @brief Signal a completion and wake its waiter
+ * @param completion Completion
+ */
+void cor_complete(cor_completion_t *completion);
+/**
+ * @brief Signal a completion from an interrupt, lock-free
+ * @param completion Completion
+ */
+void cor_complete_from_isr(cor_completion_t *completion);
+#if COR_USE_EPOLL
+/**
+ * @brief Get the epoll descriptor behind cor_await_fd, for an outer event loop to poll along with its own
+ * @return Descriptor, -1 if it could not be created
+ * @note Once it is readable, the next dispatch (cor_run_once, cor_run_until_idle) wakes the waiting tasks.
+ */
+int cor_io_fd(void);
+#endif
+#if COR_TRACE_SIZE > 0
+/**
+ * @brief Copy the trace out, a cor_trace_header_t followed by the records oldest first
+ * @param buf Destination, e.g. a buffer then sent over a UART or read by the debugger
+ * @param len Size of buf, records that do not fit are left out from the newest end
+ * @return Bytes written, 0 if buf is too small for the header
+ */
+size_t cor_trace_export(void *buf, size_t len);
+/**
+ * @brief Drop all recorded events
+ */
+void cor_trace_clear(void);
+#endif
+/**
+ * @brief Get the tick at which the earliest sleeping task is due
+ * @param deadline Receives the tick
+ * @return false if no task is sleeping
+ */
+bool cor_next_deadline(cor_tick_t *deadline);
+/**
+ * @brief Get the time until the earliest sleeping task is due
+ * @return Milliseconds, 0 if already due, COR_WAIT_FOREVER if no task is sleeping
+ */
+uint32_t cor_next_timeout(void);
+/**
+ * @brief Cut short the tickless idle sleep, can be called from an interrupt
+ */
+void cor_wakeup(void);
+/**
+ * @brief Check whether cor_wakeup was called since the last dispatch
+ * @return true if the scheduler should not go to sleep
+ */
+bool cor_wakeup_pending(void);
 
+#if COR_USE_SWITCH
+#define COR_BEGIN()                          \
+    switch ((uintptr_t)cor_begin((void *)0)) \
+    {                                        \
+    case 0:
+/* Last statement of a task */
+#define COR_END() }
+#else
 #define COR_BEGIN()             \
     goto *cor_begin(&&label_0); \
     label_0:
-#define cor_yield()                          \
-    do                                       \
-    {                                        \
-        yield(&&UNIQUE_LABEL, COR_READY, 0); \
-        return;                              \
-        RESUMESTATE();                       \
+#define COR_END()
+#endif
+#define cor_yield()                     \
+    do                                  \
+    {                                   \
+        yield(COR_LABEL, COR_READY, 0); \
+        return;                         \
+        RESUMESTATE();                  \
     } while (0)
 #define cor_suspend(handle) \
     do                      \
@@ -156,55 +1069,374 @@ bool cor_create_task(cor_handle_t *handle, void (*callback)(void *arg), void *ar
         }                   \
     } while (0)
 #define cor_resume(handle) resume(handle)
-#define cor_sleep(ms)                                                   \
-    do                                                                  \
-    {                                                                   \
-        yield(&&UNIQUE_LABEL, COR_WAITING, (ms) < 100 ? (ms) : (ms)-1); \
-        return;                                                         \
-        RESUMESTATE();                                                  \
-    } while (0)
-#define cor_mutex_lock(handle) \
-    do                         \
-    {                          \
-        mutex_lock(handle);    \
-        if (*handle != 0)      \
-        {                      \
-            return;            \
-            RESUMESTATE();     \
-        }                      \
+#define cor_task_exit() \
+    do                  \
+    {                   \
+        task_exit();    \
+        return;         \
+    } while (0)
+#define cor_sleep(ms)                                       \
+    do                                                      \
+    {                                                       \
+        yield(COR_LABEL, COR_WAITING, cor_ms_to_ticks(ms)); \
+        return;                                             \
+        RESUMESTATE();                                      \
+    } while (0)
+#define cor_sleep_us(us)                                    \
+    do                                                      \
+    {                                                       \
+        yield(COR_LABEL, COR_WAITING, cor_us_to_ticks(us)); \
+        return;                                             \
+        RESUMESTATE();                                      \
+    } while (0)
+/* deadline is an absolute tick, see cor_get_tick */
+#define cor_sleep_until(deadline)           \
+    do                                      \
+    {                                       \
+        sleep_until(COR_LABEL, (deadline)); \
+        return;                             \
+        RESUMESTATE();                      \
+    } while (0)
+/* Fixed-rate loop, releases every ms milliseconds without drift */
+#define cor_periodic(ms)                          \
+    do                                            \
+    {                                             \
+        periodic(COR_LABEL, cor_ms_to_ticks(ms)); \
+        return;                                   \
+        RESUMESTATE();                            \
+    } while (0)
+#define cor_mutex_lock(handle)              \
+    do                                      \
+    {                                       \
+        if (!mutex_lock(COR_LABEL, handle)) \
+        {                                   \
+            return;                         \
+        }                                   \
+        RESUMESTATE();                      \
     } while (0)
 #define cor_mutex_unlock(handle) mutex_unlock(handle)
 
-#define COR_CHILD_BEGIN(label) \
-    if (label != NULL)         \
-    {                          \
-        goto *label;           \
-    }
+/**
+ * @brief Give a semaphore, the first waiter takes it directly
+ * @param sem Semaphore
+ */
+void cor_sem_give(cor_sem_t *sem);
+/**
+ * @brief Set event flags and wake every waiter they satisfy
+ * @param event Event flag group
+ * @param flags Flags to set
+ */
+void cor_event_set(cor_event_t *event, uint32_t flags);
+/**
+ * @brief Resume every task of a slot mask, as cor_resume does each one
+ * @param mask COR_GROUP_WORDS words, bit n stands for task slot n
+ * @note Tasks are made ready with one OR per bitmap word, core and priority level.
+ */
+void cor_resume_mask(const uint32_t *mask);
+/**
+ * @brief Resume several tasks under one lock, as cor_resume does each one
+ * @param handles Task handles, stale ones are skipped
+ * @param n Number of handles
+ * @note Handles of neighbouring slots are made ready together, so list them in slot order.
+ */
+void cor_resume_many(const cor_handle_t *handles, size_t n);
+/**
+ * @brief Add a task to a group
+ * @param group Group
+ * @param handle Task handle, NULL for the calling task
+ * @return false if the handle is stale
+ */
+bool cor_group_add(cor_group_t *group, cor_handle_t *handle);
+/**
+ * @brief Take a task out of a group
+ * @param group Group
+ * @param handle Task handle, NULL for the calling task
+ */
+void cor_group_remove(cor_group_t *group, cor_handle_t *handle);
+/**
+ * @brief Resume every task of a group
+ * @param group Group
+ */
+void cor_resume_group(const cor_group_t *group);
+/**
+ * @brief Suspend every task of a group but the calling one, as cor_suspend does each one
+ * @param group Group
+ */
+void cor_suspend_group(const cor_group_t *group);
+/**
+ * @brief Clear event flags
+ * @param event Event flag group
+ * @param flags Flags to clear
+ */
+void cor_event_clear(cor_event_t *event, uint32_t flags);
+
+/**
+ * @brief Notify a task from an interrupt, lock free
+ * @param handle Task handle
+ * @note The notification is folded in by the next dispatch: it wakes the task from cor_notify_wait,
+ *       resumes it if suspended, otherwise it is latched for the next cor_notify_wait.
+ */
+void cor_notify_from_isr(cor_handle_t *handle);
+/**
+ * @brief Notify a task from another task, same effect as cor_notify_from_isr without the deferral
+ * @param handle Task handle
+ */
+void cor_notify(cor_handle_t *handle);
+
+/**
+ * @brief Push a message into a ring, can be called from an interrupt
+ * @param spsc Ring
+ * @param msg Message
+ * @return false if the ring is full
+ */
+bool cor_spsc_push(cor_spsc_t *spsc, void *msg);
+/**
+ * @brief Pop a message from a ring without blocking, can be called from an interrupt
+ * @param spsc Ring
+ * @param msg Receives the message
+ * @return false if the ring is empty
+ */
+bool cor_spsc_pop(cor_spsc_t *spsc, void **msg);
 
-#define cor_child_task(name, callback)           \
+#define cor_sem_take(sem)                                \
+    do                                                   \
+    {                                                    \
+        if (!sem_take(COR_LABEL, sem, COR_WAIT_FOREVER)) \
+        {                                                \
+            return;                                      \
+        }                                                \
+        RESUMESTATE();                                   \
+    } while (0)
+/* ok is set to true if the semaphore was taken, false on timeout */
+#define cor_sem_take_timeout(sem, ms, ok)    \
+    do                                       \
+    {                                        \
+        if (!sem_take(COR_LABEL, sem, (ms))) \
+        {                                    \
+            return;                          \
+        }                                    \
+        RESUMESTATE();                       \
+        ok = cor_wait_result() != 0;         \
+    } while (0)
+/* ok is set to true if notified, false on timeout */
+#define cor_notify_wait(ms, ok)            \
+    do                                     \
+    {                                      \
+        if (!notify_wait(COR_LABEL, (ms))) \
+        {                                  \
+            return;                        \
+        }                                  \
+        RESUMESTATE();                     \
+        ok = cor_wait_result() != 0;       \
+    } while (0)
+/* ok is set to true once completed, false on timeout */
+#define cor_await_completion(completion, ms, ok)              \
+    do                                                        \
+    {                                                         \
+        if (!await_completion(COR_LABEL, (completion), (ms))) \
+        {                                                     \
+            return;                                           \
+        }                                                     \
+        RESUMESTATE();                                        \
+        ok = cor_wait_result() != 0;                          \
+    } while (0)
+#if COR_USE_EPOLL
+/* revents is set to the ready epoll events, 0 on timeout or if fd cannot be polled,
+   errno is EBUSY in the latter case when another task already waits on fd */
+#define cor_await_fd(fd, events, ms, revents)           \
+    do                                                  \
+    {                                                   \
+        if (!await_fd(COR_LABEL, (fd), (events), (ms))) \
+        {                                               \
+            return;                                     \
+        }                                               \
+        RESUMESTATE();                                  \
+        revents = cor_wait_result();                    \
+    } while (0)
+#endif
+#define cor_chan_send(chan, msg)                                  \
+    do                                                            \
+    {                                                             \
+        if (!chan_send(COR_LABEL, chan, (msg), COR_WAIT_FOREVER)) \
+        {                                                         \
+            return;                                               \
+        }                                                         \
+        RESUMESTATE();                                            \
+    } while (0)
+/* ok is set to true if the message was sent, false on timeout */
+#define cor_chan_send_timeout(chan, msg, ms, ok)      \
+    do                                                \
+    {                                                 \
+        if (!chan_send(COR_LABEL, chan, (msg), (ms))) \
+        {                                             \
+            return;                                   \
+        }                                             \
+        RESUMESTATE();                                \
+        ok = cor_wait_result() != 0;                  \
+    } while (0)
+/* out is set to the received message */
+#define cor_chan_recv(chan, out)                           \
+    do                                                     \
+    {                                                      \
+        if (!chan_recv(COR_LABEL, chan, COR_WAIT_FOREVER)) \
+        {                                                  \
+            return;                                        \
+        }                                                  \
+        RESUMESTATE();                                     \
+        out = cor_wait_msg();                              \
+    } while (0)
+/* out is set to the received message, ok to false on timeout */
+#define cor_chan_recv_timeout(chan, out, ms, ok) \
     do                                           \
     {                                            \
-        static void *name = 0;                   \
-        CONCAT(child_label_, name) :             \
+        if (!chan_recv(COR_LABEL, chan, (ms)))   \
         {                                        \
-            uint32_t t = callback(name);         \
-            if (t != 0)                          \
-            {                                    \
-                cor_sleep(t);                    \
-                goto CONCAT(child_label_, name); \
-            }                                    \
+            return;                              \
         }                                        \
+        RESUMESTATE();                           \
+        ok = cor_wait_result() != 0;             \
+        out = cor_wait_msg();                    \
     } while (0)
-
-#define cor_child_sleep(ms, label) \
-    do                             \
-    {                              \
-        label = &&UNIQUE_LABEL;    \
-        return (ms);               \
-    UNIQUE_LABEL:                  \
-        label = NULL;              \
+/* out is set to the received message, retried after every wake-up */
+#define cor_spsc_recv(spsc, out)         \
+    do                                   \
+    {                                    \
+        RESUMESTATE();                   \
+        if (!spsc_recv(COR_LABEL, spsc)) \
+        {                                \
+            return;                      \
+        }                                \
+        out = cor_wait_msg();            \
+    } while (0)
+/* flags is set to the matched flags, 0 on timeout */
+#define cor_event_wait(event, mask, mode, ms, flags)             \
+    do                                                           \
+    {                                                            \
+        if (!event_wait(COR_LABEL, event, (mask), (mode), (ms))) \
+        {                                                        \
+            return;                                              \
+        }                                                        \
+        RESUMESTATE();                                           \
+        flags = cor_wait_result();                               \
     } while (0)
 
+#if COR_ENABLE_STACKFUL
+/* Waits of a stackful task, the same as the cor_ macros of the same name but callable at any depth */
+void cor_stack_yield(void);
+void cor_stack_sleep(uint32_t ms);
+void cor_stack_sleep_until(cor_tick_t deadline);
+void cor_stack_suspend(void);
+void cor_stack_exit(void);
+void cor_stack_mutex_lock(muxtex_handle_t *handle);
+/* The waits with a timeout return false, or 0 for the flag and event forms, on timeout */
+bool cor_stack_sem_take(cor_sem_t *sem, uint32_t timeout);
+bool cor_stack_notify_wait(uint32_t timeout);
+uint32_t cor_stack_event_wait(cor_event_t *event, uint32_t mask, uint8_t mode, uint32_t timeout);
+bool cor_stack_chan_send(cor_chan_t *chan, void *msg, uint32_t timeout);
+bool cor_stack_chan_recv(cor_chan_t *chan, void **out, uint32_t timeout);
+void *cor_stack_spsc_recv(cor_spsc_t *spsc);
+bool cor_stack_await_completion(cor_completion_t *completion, uint32_t timeout);
+#if COR_USE_EPOLL
+uint32_t cor_stack_await_fd(int fd, uint32_t events, uint32_t timeout);
+#endif
+#endif
+
+/* At task level there is no enclosing child, COR_CHILD_BEGIN shadows both inside a child routine */
+enum
+{
+    cor_child_level = 0
+};
+static cor_child_t *const cor_child_self = NULL;
 
+/* Declare the nesting depth of a child routine, 1 for one called by tasks; callers must be shallower */
+#define COR_CHILD_DEPTH(name, depth)       \
+    enum                                   \
+    {                                      \
+        CONCAT(name, _cor_depth) = (depth) \
+    };                                     \
+    COR_STATIC_ASSERT((depth) >= 1 && (depth) <= COR_CHILD_MAX_DEPTH, "child depth out of 1..COR_CHILD_MAX_DEPTH")
+/* First statement of a child routine void name(ctx_type *ctx), ctx_type starts with a cor_child_t */
+#define COR_CHILD_BEGIN(name, ctx)                            \
+    enum                                                      \
+    {                                                         \
+        cor_child_level = CONCAT(name, _cor_depth)            \
+    };                                                        \
+    cor_child_t *const cor_child_self = (cor_child_t *)(ctx); \
+    COR_CHILD_RESUME()
+#if COR_USE_SWITCH
+#define COR_CHILD_RESUME()                    \
+    switch ((uintptr_t)cor_child_self->label) \
+    {                                         \
+    case 0:
+/* Last statement of a child routine */
+#define COR_CHILD_END() }
+#else
+#define COR_CHILD_RESUME()             \
+    if (cor_child_self->label != NULL) \
+    {                                  \
+        goto *cor_child_self->label;   \
+    }
+#define COR_CHILD_END()
+#endif
+/* Run a child to its end from a task or a child, the caller blocks whenever the child does */
+#define cor_child_call(name, ctx)                                                                                               \
+    do                                                                                                                          \
+    {                                                                                                                           \
+        COR_STATIC_ASSERT((int)CONCAT(name, _cor_depth) > (int)cor_child_level, "child called from its own or a deeper level"); \
+        ((cor_child_t *)(ctx))->label = NULL;                                                                                   \
+        if (cor_child_self != NULL)                                                                                             \
+        {                                                                                                                       \
+            cor_child_self->label = COR_LABEL;                                                                                  \
+        }                                                                                                                       \
+    COR_MARK()                                                                                                                  \
+        ((cor_child_t *)(ctx))->resume = cor_child_self != NULL ? cor_child_self->resume : COR_LABEL;                           \
+        name(ctx);                                                                                                              \
+        if (((cor_child_t *)(ctx))->label != NULL)                                                                              \
+        {                                                                                                                       \
+            return;                                                                                                             \
+        }                                                                                                                       \
+        if (cor_child_self != NULL)                                                                                             \
+        {                                                                                                                       \
+            cor_child_self->label = NULL;                                                                                       \
+        }                                                                                                                       \
+        else                                                                                                                    \
+        {                                                                                                                       \
+            cor_set_sw_state(SW_NORMAL);                                                                                        \
+        }                                                                                                                       \
+    } while (0)
+#define cor_child_yield()                            \
+    do                                               \
+    {                                                \
+        cor_child_self->label = COR_LABEL;           \
+        yield(cor_child_self->resume, COR_READY, 0); \
+        return;                                      \
+    COR_MARK()                                       \
+        cor_child_self->label = NULL;                \
+    } while (0)
+#define cor_child_sleep(ms)                                              \
+    do                                                                   \
+    {                                                                    \
+        cor_child_self->label = COR_LABEL;                               \
+        yield(cor_child_self->resume, COR_WAITING, cor_ms_to_ticks(ms)); \
+        return;                                                          \
+    COR_MARK()                                                           \
+        cor_child_self->label = NULL;                                    \
+    } while (0)
+/* Any blocking call taking the resume label first, e.g. cor_child_await(sem_take, &sem, 100); read the outcome with cor_wait_result */
+#define cor_child_await(fn, ...)                      \
+    do                                                \
+    {                                                 \
+        cor_child_self->label = COR_LABEL;            \
+        if (!fn(cor_child_self->resume, __VA_ARGS__)) \
+        {                                             \
+            return;                                   \
+        }                                             \
+    COR_MARK()                                        \
+        cor_child_self->label = NULL;                 \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,561 @@
+/**
+ * @file coroutine.hpp
+ * @brief C++20 front-end: tasks written as co_await coroutines, run by the same scheduler.
+ * @note A cor::Task started with cor::spawn takes one slot of the task table and is dispatched like any
+ *       other task. When it awaits a kernel object the wait is registered exactly as by the cor_ macros,
+ *       so it mixes freely with C tasks. Its frame, and the frames of the Tasks it awaits, come from the
+ *       block pool of the core (COR_POOL_SIZE > 0) or else from a fixed arena of COR_CPP_ARENA_SIZE
+ *       bytes, never from operator new; a Task whose frame does not fit is empty, see Task::operator bool.
+ *       Exceptions may be disabled.
+ *       Build with -std=c++20 (plus -fcoroutines on GCC 10).
+ */
+
+#ifndef COROUTINE_HPP
+#define COROUTINE_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+#include "coroutine.h"
+#if COR_NUM_CORES > 1 || COR_ENABLE_INSTANCES
+#include <atomic>
+#endif
+
+/**
+ * Bytes of the arena holding the coroutine frames of every cor::Task.
+ */
+#ifndef COR_CPP_ARENA_SIZE
+#define COR_CPP_ARENA_SIZE (4096)
+#endif
+
+namespace cor
+{
+template <typename T = void>
+class Task;
+
+namespace detail
+{
+/**
+ * @brief First fit allocator over a static buffer, freed neighbours merge again.
+ */
+class Arena
+{
+public:
+    void *alloc(std::size_t size) noexcept
+    {
+        Block **link;
+        void *ptr = nullptr;
+        size = (size + header + align - 1) & ~(align - 1);
+        lock();
+        if (!ready)
+        {
+            freelist = reinterpret_cast<Block *>(buf);
+            freelist->size = sizeof(buf) & ~(align - 1);
+            freelist->next = nullptr;
+            ready = true;
+        }
+        for (link = &freelist; *link != nullptr; link = &(*link)->next)
+        {
+            Block *block = *link;
+            if (block->size < size)
+            {
+                continue;
+            }
+            // Split off the tail unless what is left could not hold a frame anyway
+            if (block->size - size >= header + align)
+            {
+                Block *rest = reinterpret_cast<Block *>(reinterpret_cast<unsigned char *>(block) + size);
+                rest->size = block->size - size;
+                rest->next = block->next;
+                block->size = size;
+                *link = rest;
+            }
+            else
+            {
+                *link = block->next;
+            }
+            ptr = reinterpret_cast<unsigned char *>(block) + header;
+            break;
+        }
+        unlock();
+        return ptr;
+    }
+    bool owns(const void *ptr) const noexcept
+    {
+        return ptr >= static_cast<const void *>(buf) && ptr < static_cast<const void *>(buf + sizeof(buf));
+    }
+    void release(void *ptr) noexcept
+    {
+        Block *block = reinterpret_cast<Block *>(static_cast<unsigned char *>(ptr) - header);
+        Block *prev = nullptr;
+        Block *next;
+        lock();
+        // The free list is kept in address order so both neighbours are found on the way
+        for (next = freelist; next != nullptr && next < block; next = next->next)
+        {
+            prev = next;
+        }
+        block->next = next;
+        if (next != nullptr && end(block) == reinterpret_cast<unsigned char *>(next))
+        {
+            block->size += next->size;
+            block->next = next->next;
+        }
+        if (prev == nullptr)
+        {
+            freelist = block;
+        }
+        else if (end(prev) == reinterpret_cast<unsigned char *>(block))
+        {
+            prev->size += block->size;
+            prev->next = block->next;
+        }
+        else
+        {
+            prev->next = block;
+        }
+        unlock();
+    }
+
+private:
+    struct Block
+    {
+        std::size_t size; /* Bytes of the block, header included */
+        Block *next;      /* Next free block by address, only while free */
+    };
+    static constexpr std::size_t align = alignof(std::max_align_t);
+    static constexpr std::size_t header = (sizeof(Block) + align - 1) & ~(align - 1);
+
+    static unsigned char *end(Block *block) noexcept
+    {
+        return reinterpret_cast<unsigned char *>(block) + block->size;
+    }
+    // Shared by every scheduler instance, and so by every thread running one
+#if COR_NUM_CORES > 1 || COR_ENABLE_INSTANCES
+    void lock() noexcept
+    {
+        while (busy.test_and_set(std::memory_order_acquire))
+        {
+        }
+    }
+    void unlock() noexcept
+    {
+        busy.clear(std::memory_order_release);
+    }
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+#else
+    void lock() noexcept
+    {
+    }
+    void unlock() noexcept
+    {
+    }
+#endif
+
+    alignas(std::max_align_t) unsigned char buf[COR_CPP_ARENA_SIZE];
+    Block *freelist = nullptr;
+    bool ready = false; /* The whole buffer becomes one free block on the first alloc */
+};
+inline Arena arena;
+
+/**
+ * @brief Per spawned task: the innermost coroutine of its await chain, resumed on each dispatch.
+ */
+struct Root
+{
+    std::coroutine_handle<> leaf;
+};
+/* Root of the task each core is running, set before the task is resumed */
+#if COR_ENABLE_INSTANCES
+inline COR_THREAD_LOCAL Root *current[COR_NUM_CORES];
+#else
+inline Root *current[COR_NUM_CORES];
+#endif
+
+/**
+ * @brief Parts of a Task promise that do not depend on the result type.
+ */
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation; /* Coroutine awaiting this one, none for a spawned task */
+    Root root;                            /* Used by the outermost coroutine of a spawned task only */
+
+    static void *operator new(std::size_t size) noexcept
+    {
+#if COR_POOL_SIZE > 0
+        // Frames of one coroutine function all have the same size, so they recycle one size class
+        void *ptr = cor_pool_alloc(size);
+        if (ptr != nullptr)
+        {
+            return ptr;
+        }
+#endif
+        return arena.alloc(size);
+    }
+    static void operator delete(void *ptr) noexcept
+    {
+        if (arena.owns(ptr))
+        {
+            arena.release(ptr);
+        }
+#if COR_POOL_SIZE > 0
+        else
+        {
+            cor_pool_free(ptr);
+        }
+#endif
+    }
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> self) noexcept
+        {
+            // Straight back into the awaiting coroutine, or out to the scheduler for a spawned task
+            std::coroutine_handle<> next = self.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept
+        {
+        }
+    };
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+    void unhandled_exception() noexcept
+    {
+        std::terminate();
+    }
+};
+template <typename T>
+struct Value
+{
+    T value{};
+    void return_value(T v) noexcept
+    {
+        value = std::move(v);
+    }
+    T result() noexcept
+    {
+        return std::move(value);
+    }
+};
+template <>
+struct Value<void>
+{
+    void return_void() noexcept
+    {
+    }
+    void result() noexcept
+    {
+    }
+};
+
+/**
+ * @brief Awaiter of a kernel wait: start registers it and returns true if it is already over,
+ *        result reads the outcome once the task is dispatched again.
+ */
+template <typename Start, typename Result>
+struct Wait
+{
+    Start start;
+    Result result;
+
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> self) noexcept
+    {
+        current[COR_CORE_ID()]->leaf = self;
+        return !start();
+    }
+    auto await_resume() noexcept
+    {
+        return result();
+    }
+};
+template <typename Start, typename Result>
+Wait<Start, Result> wait(Start start, Result result) noexcept
+{
+    return Wait<Start, Result>{start, result};
+}
+inline auto no_result() noexcept
+{
+    return [] {};
+}
+inline auto done_result() noexcept
+{
+    return [] { return cor_wait_result() != 0; };
+}
+/**
+ * @brief One try of an SPSC receive, done is false if the task was woken with the ring still empty.
+ */
+struct SpscTry
+{
+    cor_spsc_t *spsc;
+    bool done;
+
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> self) noexcept
+    {
+        current[COR_CORE_ID()]->leaf = self;
+        done = spsc_recv(NULL, spsc);
+        return !done;
+    }
+    bool await_resume() noexcept
+    {
+        return done;
+    }
+};
+
+void run(void *arg);
+} // namespace detail
+
+#if COR_POOL_SIZE > 0
+/**
+ * @brief Base of per-session objects created with new, which then come from the block pool.
+ * @note new yields nullptr once the pool is exhausted, the object may be deleted from any core.
+ */
+struct Pooled
+{
+    static void *operator new(std::size_t size) noexcept
+    {
+        return cor_pool_alloc(size);
+    }
+    static void operator delete(void *ptr) noexcept
+    {
+        cor_pool_free(ptr);
+    }
+};
+#endif
+
+/**
+ * @brief Coroutine returning T, spawned as a task of its own or awaited by another Task.
+ * @note Tasks start suspended. Awaiting one runs it on the same scheduler task until it returns,
+ *       its frame is freed once the awaiting expression is done. T must be default constructible.
+ */
+template <typename T>
+class Task
+{
+public:
+    struct promise_type : detail::PromiseBase, detail::Value<T>
+    {
+        Task get_return_object() noexcept
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        static Task get_return_object_on_allocation_failure() noexcept
+        {
+            return Task();
+        }
+    };
+
+    Task() noexcept = default;
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr))
+    {
+    }
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+    /**
+     * @brief false if the arena had no room for the frame
+     */
+    explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(handle);
+    }
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> callee;
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+            {
+                callee.promise().continuation = caller;
+                return callee;
+            }
+            T await_resume() noexcept
+            {
+                return callee.promise().result();
+            }
+        };
+        assert_param(handle);
+        return Awaiter{handle};
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) noexcept : handle(h)
+    {
+    }
+    friend bool spawn(cor_handle_t *handle, Task<void> task, uint8_t prio);
+    friend void detail::run(void *arg);
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Start a Task as a scheduler task
+ * @param handle Task handle
+ * @param task Task, e.g. the result of calling a coroutine function
+ * @param prio Priority, 0 (lowest) to COR_PRIO_LEVELS - 1
+ * @return false if the Task is empty or the task table is full
+ * @note The scheduler task ends when the Task returns, its frame then goes back to the arena.
+ *       Deleting it with cor_delete_task instead leaks the frames of its await chain.
+ */
+inline bool spawn(cor_handle_t *handle, Task<void> task, uint8_t prio = COR_PRIO_DEFAULT)
+{
+    if (!task)
+    {
+        return false;
+    }
+    // The first dispatch resumes the Task from its initial suspension point
+    task.handle.promise().root.leaf = task.handle;
+    if (!cor_create_task_ex(handle, detail::run, &task.handle.promise(), prio))
+    {
+        return false;
+    }
+    task.handle = nullptr;
+    return true;
+}
+
+inline void detail::run(void *arg)
+{
+    Task<void>::promise_type &promise = *static_cast<Task<void>::promise_type *>(arg);
+    std::coroutine_handle<Task<void>::promise_type> self = std::coroutine_handle<Task<void>::promise_type>::from_promise(promise);
+    current[COR_CORE_ID()] = &promise.root;
+    promise.root.leaf.resume();
+    if (self.done())
+    {
+        self.destroy();
+        task_exit();
+    }
+}
+
+/* Awaitables of the kernel waits, the same as the cor_ macros of the same name */
+inline auto yield() noexcept
+{
+    return detail::wait([] {
+        ::yield(NULL, COR_READY, 0);
+        return false;
+    }, detail::no_result());
+}
+inline auto sleep(uint32_t ms) noexcept
+{
+    return detail::wait([ms] {
+        ::yield(NULL, COR_WAITING, cor_ms_to_ticks(ms));
+        return false;
+    }, detail::no_result());
+}
+inline auto sleep_us(uint32_t us) noexcept
+{
+    return detail::wait([us] {
+        ::yield(NULL, COR_WAITING, cor_us_to_ticks(us));
+        return false;
+    }, detail::no_result());
+}
+/* deadline is an absolute tick, see cor_get_tick */
+inline auto sleep_until(cor_tick_t deadline) noexcept
+{
+    return detail::wait([deadline] {
+        ::sleep_until(NULL, deadline);
+        return false;
+    }, detail::no_result());
+}
+/* Fixed-rate loop, releases every ms milliseconds without drift */
+inline auto periodic(uint32_t ms) noexcept
+{
+    return detail::wait([ms] {
+        ::periodic(NULL, cor_ms_to_ticks(ms));
+        return false;
+    }, detail::no_result());
+}
+/* Release with cor_mutex_unlock */
+inline auto lock(cor_mutex_t &mutex) noexcept
+{
+    return detail::wait([&mutex] { return mutex_lock(NULL, &mutex); }, detail::no_result());
+}
+/* The waits with a timeout result in false, or 0 for the event flags, on timeout */
+inline auto take(cor_sem_t &sem, uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([&sem, ms] { return sem_take(NULL, &sem, ms); }, detail::done_result());
+}
+inline auto notified(uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([ms] { return notify_wait(NULL, ms); }, detail::done_result());
+}
+/* Results in the matched flags */
+inline auto wait(cor_event_t &event, uint32_t mask, uint8_t mode, uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([&event, mask, mode, ms] { return event_wait(NULL, &event, mask, mode, ms); },
+                        [] { return cor_wait_result(); });
+}
+inline auto send(cor_chan_t &chan, void *msg, uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([&chan, msg, ms] { return chan_send(NULL, &chan, msg, ms); }, detail::done_result());
+}
+/* Results in the message, NULL on timeout */
+inline auto recv(cor_chan_t &chan, uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([&chan, ms] { return chan_recv(NULL, &chan, ms); }, [] { return cor_wait_msg(); });
+}
+inline auto completion(cor_completion_t &completion, uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([&completion, ms] { return await_completion(NULL, &completion, ms); }, detail::done_result());
+}
+#if COR_USE_EPOLL
+/* Results in the ready epoll events, 0 on timeout */
+inline auto poll(int fd, uint32_t events, uint32_t ms = COR_WAIT_FOREVER) noexcept
+{
+    return detail::wait([fd, events, ms] { return await_fd(NULL, fd, events, ms); }, [] { return cor_wait_result(); });
+}
+#endif
+/* Results in the message; a child Task, so its frame takes room in the arena while it waits */
+inline Task<void *> recv(cor_spsc_t &spsc)
+{
+    detail::SpscTry attempt{&spsc, false};
+    // Every wake-up only means the ring may have filled, look again
+    while (!co_await attempt)
+    {
+    }
+    co_return cor_wait_msg();
+}
+} // namespace cor
+
+#endif
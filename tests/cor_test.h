@@ -0,0 +1,30 @@
+/**
+ * @file cor_test.h
+ * @brief Check helper of the behaviour tests, included after the kernel source.
+ * @note A failed check prints its file, line and condition; main returns cor_test_result().
+ */
+
+#ifndef COR_TEST_H
+#define COR_TEST_H
+
+#include <stdio.h>
+
+static int cor_test_failures;
+
+#define COR_CHECK(cond)                                                      \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            cor_test_failures += 1;                                          \
+        }                                                                    \
+    } while (0)
+
+static int cor_test_result(const char *name)
+{
+    printf("%s: %s\n", name, cor_test_failures == 0 ? "ok" : "FAILED");
+    return cor_test_failures != 0;
+}
+
+#endif
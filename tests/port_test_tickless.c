@@ -0,0 +1,30 @@
+/**
+ * @file port_test_tickless.c
+ * @brief Tickless hook of test_tickless.c, it stands in for the port and jumps the clock across each sleep.
+ */
+
+#include "../coroutine.h"
+
+#define TEST_SLEEPS 8
+
+extern uint32_t test_now;
+extern uint32_t test_slept[TEST_SLEEPS];
+extern int test_sleeps;
+extern cor_handle_t test_waiter;
+
+void cor_tickless_callback(uint32_t ms)
+{
+    if (test_sleeps < TEST_SLEEPS)
+    {
+        test_slept[test_sleeps] = ms;
+    }
+    test_sleeps += 1;
+    // The third sleep is cut short by an interrupt that readies the waiter
+    if (test_sleeps == 3)
+    {
+        test_now += 5;
+        cor_notify_from_isr(&test_waiter);
+        return;
+    }
+    test_now += ms == COR_WAIT_FOREVER ? 1000 : ms;
+}
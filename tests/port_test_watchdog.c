@@ -0,0 +1,21 @@
+/**
+ * @file port_test_watchdog.c
+ * @brief Watchdog hook of test_watchdog.c, it records each overrun it is told about.
+ */
+
+#define COR_ENABLE_WATCHDOG 1
+#include "../coroutine.h"
+
+extern cor_handle_t test_hog;
+extern uint32_t test_spent;
+extern uint16_t test_seen;
+extern int test_bites;
+
+void cor_watchdog_callback(cor_handle_t handle, uint32_t cycles)
+{
+    // The handle still names the task, its count already includes this run
+    test_hog = handle;
+    test_spent = cycles;
+    test_seen = cor_get_hogs(&handle, false);
+    test_bites += 1;
+}
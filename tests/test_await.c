@@ -0,0 +1,125 @@
+/**
+ * @file test_await.c
+ * @brief Completion and descriptor waiters stay parked until their event or timeout, then run once.
+ * @note The tick is stepped by hand, a pipe stands in for the socket or UART.
+ */
+
+#define COR_USE_EPOLL 1
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static uint32_t test_now;
+static int test_pipe[2];
+static cor_completion_t test_dma = COR_COMPLETION_INIT;
+static int test_dma_ok[3];
+static uint32_t test_dma_at[3];
+static uint32_t test_revents[2];
+static uint32_t test_read_at;
+static char test_byte;
+static uint32_t test_busy_revents = 1;
+static int test_busy_errno;
+static int test_runs[3];
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_step(uint32_t to)
+{
+    while (test_now < to)
+    {
+        test_now += 1;
+        cor_run_until_idle();
+    }
+}
+
+// Times out, then waits for the interrupt, then finds the next one already signalled
+static void test_dma_wait(void *arg)
+{
+    static int i;
+    bool ok;
+    COR_BEGIN();
+    for (i = 0; i < 3; i++)
+    {
+        test_runs[0] += 1;
+        cor_await_completion(&test_dma, i == 0 ? 20 : COR_WAIT_FOREVER, ok);
+        test_dma_ok[i] = ok;
+        test_dma_at[i] = test_now;
+        if (i == 1)
+        {
+            cor_complete(&test_dma);
+        }
+    }
+    cor_task_exit();
+}
+
+static void test_reader(void *arg)
+{
+    uint32_t revents;
+    COR_BEGIN();
+    test_runs[1] += 1;
+    cor_await_fd(test_pipe[0], EPOLLIN, 50, revents);
+    test_revents[0] = revents;
+    test_runs[1] += 1;
+    cor_await_fd(test_pipe[0], EPOLLIN, COR_WAIT_FOREVER, revents);
+    test_revents[1] = revents;
+    test_read_at = test_now;
+    COR_CHECK(read(test_pipe[0], &test_byte, 1) == 1);
+    cor_task_exit();
+}
+
+// Same descriptor as the reader, refused while the reader waits on it
+static void test_second(void *arg)
+{
+    uint32_t revents;
+    COR_BEGIN();
+    test_runs[2] += 1;
+    errno = 0;
+    cor_await_fd(test_pipe[0], EPOLLIN, COR_WAIT_FOREVER, revents);
+    test_busy_revents = revents;
+    test_busy_errno = errno;
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    struct pollfd pfd;
+    COR_CHECK(pipe(test_pipe) == 0 && fcntl(test_pipe[0], F_SETFL, O_NONBLOCK) == 0);
+    cor_init(4, test_tick);
+    COR_CHECK(cor_create_task(&h, test_dma_wait, NULL));
+    COR_CHECK(cor_create_task(&h, test_reader, NULL));
+    cor_run_until_idle();
+
+    test_step(20);
+    COR_CHECK(test_dma_at[0] == 20 && test_dma_ok[0] == 0);
+    test_step(30);
+    cor_complete_from_isr(&test_dma);
+    cor_run_until_idle();
+    // Woken at once, the third wait consumed the completion signalled before it
+    COR_CHECK(test_dma_at[1] == 30 && test_dma_ok[1] == 1);
+    COR_CHECK(test_dma_at[2] == 30 && test_dma_ok[2] == 1 && test_runs[0] == 3);
+
+    test_step(50);
+    COR_CHECK(test_revents[0] == 0 && test_runs[1] == 2);
+    COR_CHECK(cor_create_task(&h, test_second, NULL));
+    cor_run_until_idle();
+    COR_CHECK(test_busy_revents == 0 && test_busy_errno == EBUSY);
+
+    // The epoll descriptor turns readable for an outer loop, the next dispatch wakes the reader
+    test_step(60);
+    COR_CHECK(write(test_pipe[1], "x", 1) == 1);
+    pfd.fd = cor_io_fd();
+    pfd.events = POLLIN;
+    COR_CHECK(pfd.fd >= 0 && poll(&pfd, 1, 0) == 1);
+    cor_run_until_idle();
+    COR_CHECK(test_read_at == 60 && (test_revents[1] & EPOLLIN) && test_byte == 'x');
+    COR_CHECK(test_runs[1] == 2);
+    COR_CHECK(cor_run_until_idle() == COR_WAIT_FOREVER);
+    cor_deinit();
+    return cor_test_result("await");
+}
@@ -0,0 +1,74 @@
+/**
+ * @file test_bench.c
+ * @brief The benchmark suite runs every case for every task count and prints one well formed JSON line each.
+ * @note The suite is built in with its main renamed and run with a few iterations, the timings are not checked.
+ */
+
+#define main cor_bench_main
+#include "../bench/cor_bench.c"
+#undef main
+#include <unistd.h>
+#include "cor_test.h"
+
+#define TEST_ITERS 100
+
+static const char *const test_cases[] = {"yield_round_trip", "dispatch", "dispatch", "timer_wake", "timer_none_due"};
+
+int main(void)
+{
+    char *argv[] = {"cor_bench", "100", NULL};
+    char *usage[] = {"cor_bench", "0", NULL};
+    FILE *out = tmpfile();
+    int saved = dup(1);
+    int saved_err = dup(2);
+    char line[256];
+    char name[32];
+    unsigned n, k, iters;
+    double ns;
+    size_t row = 0;
+    size_t counts = sizeof(bench_n) / sizeof(bench_n[0]);
+
+    COR_CHECK(out != NULL && saved >= 0);
+    fflush(stdout);
+    dup2(fileno(out), 1);
+    COR_CHECK(cor_bench_main(2, argv) == 0);
+    fflush(stdout);
+    dup2(saved, 1);
+    rewind(out);
+
+    while (fgets(line, sizeof(line), out) != NULL)
+    {
+        COR_CHECK(sscanf(line, "{\"bench\":\"%31[^\"]\",\"n\":%u,\"k\":%u,\"iters\":%u,\"ns_per_op\":%lf}", name, &n, &k,
+                         &iters, &ns) == 5);
+        COR_CHECK(ns >= 0);
+        if (row < counts * 5)
+        {
+            // Five cases per task count, in the order main runs them
+            cor_id_t want = bench_n[row / 5];
+            COR_CHECK(strcmp(name, test_cases[row % 5]) == 0 && n == want);
+            COR_CHECK(k == (row % 5 == 1 ? 1 : want));
+            if (row % 5 < 3)
+            {
+                COR_CHECK(iters == TEST_ITERS);
+            }
+            else
+            {
+                COR_CHECK(iters == (TEST_ITERS / want + 1) * (row % 5 == 3 ? want : 1));
+            }
+        }
+        else
+        {
+            // Two tasks passing the mutex, one hand-off per lock
+            COR_CHECK(strcmp(name, "mutex_handoff") == 0 && n == 2 && k == 2);
+            COR_CHECK(iters >= TEST_ITERS / 2 - 1 && iters <= TEST_ITERS / 2 + 1);
+        }
+        row += 1;
+    }
+    COR_CHECK(row == counts * 5 + 1);
+    // No iterations is a usage error, its message goes into the capture file as well
+    dup2(fileno(out), 2);
+    COR_CHECK(cor_bench_main(2, usage) == 2);
+    dup2(saved_err, 2);
+    fclose(out);
+    return cor_test_result("bench");
+}
@@ -0,0 +1,105 @@
+/**
+ * @file test_child.c
+ * @brief Child routines nested two deep sleep and wait on behalf of their task, state lives in their contexts.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+typedef struct
+{
+    cor_child_t cor;
+    int i;
+    uint32_t step;
+} test_blink_t;
+
+typedef struct
+{
+    cor_child_t cor;
+    test_blink_t inner;
+    int rounds;
+    uint32_t round_at[2];
+    uint32_t sem_at;
+    uint32_t sem_ok;
+    uint32_t done_at;
+} test_outer_t;
+
+COR_CHILD_DEPTH(test_blink, 2);
+COR_CHILD_DEPTH(test_outer, 1);
+
+static uint32_t test_now;
+static cor_sem_t test_sem = COR_SEM_INIT(0);
+static test_outer_t test_ctx[2];
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+// Two sleeps of step ms
+static void test_blink(test_blink_t *ctx)
+{
+    COR_CHILD_BEGIN(test_blink, ctx);
+    for (ctx->i = 0; ctx->i < 2; ctx->i++)
+    {
+        cor_child_sleep(ctx->step);
+    }
+    COR_CHILD_END();
+}
+
+// Two rounds of test_blink, then a semaphore wait of at most 200 ms
+static void test_outer(test_outer_t *ctx)
+{
+    COR_CHILD_BEGIN(test_outer, ctx);
+    for (ctx->rounds = 0; ctx->rounds < 2; ctx->rounds++)
+    {
+        cor_child_call(test_blink, &ctx->inner);
+        ctx->round_at[ctx->rounds] = test_now;
+    }
+    cor_child_await(sem_take, &test_sem, 200);
+    ctx->sem_ok = cor_wait_result();
+    ctx->sem_at = test_now;
+    COR_CHILD_END();
+}
+
+static void test_task(void *arg)
+{
+    test_outer_t *ctx = arg;
+    COR_BEGIN();
+    cor_child_call(test_outer, ctx);
+    ctx->done_at = test_now;
+    cor_task_exit();
+}
+
+static void test_giver(void *arg)
+{
+    COR_BEGIN();
+    cor_sleep(100);
+    cor_sem_give(&test_sem);
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(4, test_tick);
+    test_ctx[0].inner.step = 10;
+    test_ctx[1].inner.step = 15;
+    COR_CHECK(cor_create_task(&h, test_task, &test_ctx[0]));
+    COR_CHECK(cor_create_task(&h, test_task, &test_ctx[1]));
+    COR_CHECK(cor_create_task(&h, test_giver, NULL));
+    cor_run_until_idle();
+    for (test_now = 1; test_now <= 300; test_now++)
+    {
+        cor_run_until_idle();
+    }
+    // Each task keeps its own pace, two sleeps per round
+    COR_CHECK(test_ctx[0].round_at[0] == 20 && test_ctx[0].round_at[1] == 40);
+    COR_CHECK(test_ctx[1].round_at[0] == 30 && test_ctx[1].round_at[1] == 60);
+    // The first waiter takes the only give, the other times out inside its child
+    COR_CHECK(test_ctx[0].sem_ok == 1 && test_ctx[0].sem_at == 100 && test_ctx[0].done_at == 100);
+    COR_CHECK(test_ctx[1].sem_ok == 0 && test_ctx[1].sem_at == 260 && test_ctx[1].done_at == 260);
+    COR_CHECK(cor_run_until_idle() == COR_WAIT_FOREVER);
+    return cor_test_result("child");
+}
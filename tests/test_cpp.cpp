@@ -0,0 +1,143 @@
+/**
+ * @file test_cpp.cpp
+ * @brief co_await tasks share the scheduler and its kernel objects with C tasks, their frames come back to the arena.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#include <cstring>
+#include "../coroutine.hpp"
+#include "cor_test.h"
+
+static uint32_t test_now;
+static cor_sem_t test_sem = COR_SEM_INIT(0);
+static cor_mutex_t test_mutex = COR_MUTEX_INIT;
+static void *test_buf[2];
+static cor_chan_t test_chan = COR_CHAN_INIT(test_buf, 2);
+static void *test_ring_buf[4];
+static cor_spsc_t test_ring = COR_SPSC_INIT(test_ring_buf, 4);
+
+struct test_result
+{
+    int sum;
+    uint32_t sum_at;
+    uint32_t locked_at;
+    bool sem_ok;
+    uint32_t sem_at;
+    intptr_t msg;
+    intptr_t ring;
+    uint32_t ring_at;
+    bool done;
+};
+static test_result test_res[2];
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_step(uint32_t to)
+{
+    while (test_now < to)
+    {
+        test_now += 1;
+        cor_run_until_idle();
+    }
+}
+
+static cor::Task<int> test_add_later(int a, int b)
+{
+    co_await cor::sleep(10);
+    co_return a + b;
+}
+
+// Locals of every level survive the sleep at the bottom
+static cor::Task<int> test_nested(int depth)
+{
+    int local = depth * 100;
+    if (depth == 0)
+    {
+        co_return co_await test_add_later(1, 2);
+    }
+    int r = co_await test_nested(depth - 1);
+    co_return r + local;
+}
+
+static cor::Task<> test_worker(int n)
+{
+    test_result &res = test_res[n];
+    res.sum = co_await test_nested(3);
+    res.sum_at = test_now;
+    co_await cor::lock(test_mutex);
+    co_await cor::sleep(5);
+    res.locked_at = test_now;
+    cor_mutex_unlock(&test_mutex);
+    res.sem_ok = co_await cor::take(test_sem, n == 0 ? 100 : 5);
+    res.sem_at = test_now;
+    res.msg = reinterpret_cast<intptr_t>(co_await cor::recv(test_chan));
+    if (n == 0)
+    {
+        res.ring = reinterpret_cast<intptr_t>(co_await cor::recv(test_ring));
+        res.ring_at = test_now;
+    }
+    res.done = true;
+}
+
+// Frame far larger than the arena
+static cor::Task<> test_huge()
+{
+    volatile char big[2 * COR_CPP_ARENA_SIZE];
+    big[0] = 1;
+    co_await cor::yield();
+    big[1] = big[0];
+}
+
+static void test_feeder(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    cor_sleep(60);
+    cor_sem_give(&test_sem);
+    cor_chan_send(&test_chan, (void *)5);
+    cor_chan_send(&test_chan, (void *)6);
+    cor_sleep(20);
+    cor_spsc_push(&test_ring, (void *)9);
+    cor_task_exit();
+}
+
+int main()
+{
+    cor_handle_t h;
+    cor_footprint_t fp;
+    cor_init(6, test_tick);
+    COR_CHECK(cor::spawn(&h, test_worker(0)));
+    COR_CHECK(cor::spawn(&h, test_worker(1), 1));
+    COR_CHECK(cor_create_task(&h, test_feeder, nullptr));
+    COR_CHECK(!cor::spawn(&h, test_huge()));
+    cor_run_until_idle();
+    test_step(100);
+
+    COR_CHECK(test_res[0].sum == 603 && test_res[1].sum == 603);
+    COR_CHECK(test_res[0].sum_at == 10 && test_res[1].sum_at == 10);
+    // The higher priority task locks first, the other gets the mutex handed over
+    COR_CHECK(test_res[1].locked_at == 15 && test_res[0].locked_at == 20);
+    COR_CHECK(!test_res[1].sem_ok && test_res[1].sem_at == 20);
+    COR_CHECK(test_res[0].sem_ok && test_res[0].sem_at == 60);
+    COR_CHECK(test_res[1].msg == 5 && test_res[0].msg == 6);
+    COR_CHECK(test_res[0].ring == 9 && test_res[0].ring_at == 80);
+    COR_CHECK(test_res[0].done && test_res[1].done);
+
+    // Every frame went back, the same tasks fit again and again
+    for (int round = 0; round < 20; round++)
+    {
+        std::memset(test_res, 0, sizeof(test_res));
+        test_sem.count = 1;
+        COR_CHECK(cor::spawn(&h, test_worker(0)));
+        COR_CHECK(cor::spawn(&h, test_worker(1)));
+        COR_CHECK(cor_create_task(&h, test_feeder, nullptr));
+        test_step(test_now + 100);
+        COR_CHECK(test_res[0].done && test_res[1].done);
+    }
+    cor_footprint_get(&fp);
+    COR_CHECK(fp.used == 3);
+    return cor_test_result("cpp");
+}
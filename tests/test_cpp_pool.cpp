@@ -0,0 +1,99 @@
+/**
+ * @file test_cpp_pool.cpp
+ * @brief With the block pool, coroutine frames and cor::Pooled objects are recycled per size class, never taken from the heap.
+ * @note The kernel is built with COR_POOL_SIZE 4096, see the Makefile. The tick is stepped by hand.
+ */
+
+#include "../coroutine.hpp"
+#include "cor_test.h"
+
+struct test_session : cor::Pooled
+{
+    int id;
+    char buf[100];
+};
+
+static uint32_t test_now;
+static int test_done;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_step(uint32_t ticks)
+{
+    for (uint32_t end = test_now + ticks; test_now < end;)
+    {
+        test_now += 1;
+        cor_run_until_idle();
+    }
+}
+
+static uint32_t test_pool_used(void)
+{
+    cor_footprint_t fp;
+    cor_footprint_get(&fp);
+    return fp.pool_used;
+}
+
+static cor::Task<int> test_inner(int n)
+{
+    co_await cor::sleep(1);
+    co_return n * 2;
+}
+
+static cor::Task<> test_outer(int n)
+{
+    int r = co_await test_inner(n);
+    test_done += r == n * 2;
+}
+
+int main()
+{
+    cor_handle_t h;
+    uint32_t used;
+    test_session *first;
+    test_session *again;
+    test_session *last = nullptr;
+    cor_init(8, test_tick);
+
+    // The first round carves frames out of the pool, later rounds take them back from the freelists
+    COR_CHECK(cor::spawn(&h, test_outer(1)));
+    COR_CHECK(cor::spawn(&h, test_outer(-1)));
+    test_step(3);
+    used = test_pool_used();
+    COR_CHECK(used > 0 && test_done == 2);
+    for (int i = 2; i <= 50; i++)
+    {
+        COR_CHECK(cor::spawn(&h, test_outer(i)));
+        COR_CHECK(cor::spawn(&h, test_outer(-i)));
+        test_step(3);
+    }
+    COR_CHECK(test_done == 100 && test_pool_used() == used);
+
+    // Pooled objects recycle the same way, nullptr once the pool is out of blocks
+    first = new test_session;
+    delete first;
+    again = new test_session;
+    COR_CHECK(first != nullptr && again == first);
+    delete again;
+    for (test_session *s = new test_session; s != nullptr; s = new test_session)
+    {
+        s->id = last != nullptr ? last->id + 1 : 0;
+        *reinterpret_cast<test_session **>(s->buf) = last;
+        last = s;
+    }
+    COR_CHECK(last != nullptr && last->id > 10);
+    // The sessions drained the pool, frames still recycle the blocks of their own class
+    COR_CHECK(cor::spawn(&h, test_outer(7)));
+    test_step(3);
+    COR_CHECK(test_done == 101);
+    while (last != nullptr)
+    {
+        test_session *prev = *reinterpret_cast<test_session **>(last->buf);
+        delete last;
+        last = prev;
+    }
+    return cor_test_result("cpp_pool");
+}
@@ -0,0 +1,74 @@
+/**
+ * @file test_edf.c
+ * @brief Under EDF only pending periodic jobs are ordered by deadline, a stale deadline does not win the pick.
+ */
+
+#define COR_ENABLE_SIM 1
+#define COR_SCHED_POLICY COR_SCHED_EDF
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static int test_runs_stale, test_runs_periodic, test_runs_plain;
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Leaves its periodic loop after one release, its deadline is long gone after that
+static void test_stale(void *arg)
+{
+    static bool once;
+    (void)arg;
+    COR_BEGIN();
+    if (!once)
+    {
+        once = true;
+        cor_periodic(1);
+    }
+    for (;;)
+    {
+        test_runs_stale += 1;
+        cor_sim_advance(1);
+        cor_yield();
+    }
+}
+
+static void test_periodic(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs_periodic += 1;
+        cor_periodic(50);
+    }
+}
+
+static void test_plain(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs_plain += 1;
+        cor_sim_advance(1);
+        cor_yield();
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(4, test_tick);
+    cor_sim_start(1000, 1);
+    cor_create_task(&h, test_stale, NULL);
+    cor_create_task(&h, test_periodic, NULL);
+    cor_create_task(&h, test_plain, NULL);
+    cor_run_for(1000);
+    COR_CHECK(test_runs_periodic == 20);
+    // The two non-periodic tasks share the CPU round robin
+    COR_CHECK(test_runs_stale == test_runs_plain);
+    COR_CHECK(test_runs_stale + test_runs_plain >= 990);
+    return cor_test_result("edf");
+}
@@ -0,0 +1,103 @@
+/**
+ * @file test_footprint.c
+ * @brief Footprint, stack high-water marks and queue peaks report what the tasks actually used.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#define COR_ENABLE_STACKFUL 1
+#define COR_ENABLE_STATS 1
+#define COR_STACK_POOL_SIZE 32768
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_STACK 8192
+#define TEST_PAD 256
+
+static uint32_t test_now;
+static void *test_buf[4];
+static cor_chan_t test_chan = COR_CHAN_INIT(test_buf, 4);
+static void *test_ring_buf[8];
+static cor_spsc_t test_ring = COR_SPSC_INIT(test_ring_buf, 8);
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+// n frames of at least TEST_PAD bytes, waiting at the bottom
+static int test_recurse(int n)
+{
+    volatile char pad[TEST_PAD];
+    pad[0] = (char)n;
+    if (n == 0)
+    {
+        cor_stack_sleep(1);
+        return 0;
+    }
+    return test_recurse(n - 1) + pad[0];
+}
+
+static void test_deep(void *arg)
+{
+    test_recurse((int)(intptr_t)arg);
+    cor_stack_suspend();
+}
+
+static void test_producer(void *arg)
+{
+    COR_BEGIN();
+    cor_chan_send(&test_chan, (void *)1);
+    cor_chan_send(&test_chan, (void *)2);
+    cor_chan_send(&test_chan, (void *)3);
+    cor_sleep(1000);
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t shallow, deep, plain, gone;
+    cor_footprint_t fp;
+    void *msg;
+    uint32_t hw_shallow, hw_deep;
+    cor_init(6, test_tick);
+    COR_CHECK(cor_create_stackful_task(&shallow, test_deep, (void *)2, 0, TEST_STACK));
+    COR_CHECK(cor_create_stackful_task(&deep, test_deep, (void *)8, 0, TEST_STACK));
+    COR_CHECK(cor_create_task(&plain, test_producer, NULL));
+    for (test_now = 0; test_now < 5; test_now++)
+    {
+        cor_run_until_idle();
+    }
+
+    // Six more frames on the deeper stack, both still well inside their stacks
+    hw_shallow = cor_stack_high_water(&shallow);
+    hw_deep = cor_stack_high_water(&deep);
+    COR_CHECK(hw_shallow >= 2 * TEST_PAD && hw_deep >= hw_shallow + 6 * TEST_PAD && hw_deep < TEST_STACK);
+    COR_CHECK(cor_stack_high_water(&plain) == 0);
+    // Peaks stay after the queues drain
+    COR_CHECK(test_chan.peak == 3);
+    for (uintptr_t i = 0; i < 5; i++)
+    {
+        COR_CHECK(cor_spsc_push(&test_ring, (void *)i));
+    }
+    while (cor_spsc_pop(&test_ring, &msg))
+    {
+    }
+    COR_CHECK(cor_spsc_push(&test_ring, NULL));
+    COR_CHECK(test_ring.peak == 5);
+
+    cor_footprint_get(&fp);
+    COR_CHECK(fp.entry == sizeof(Coroutine_t) && fp.table == 7 * sizeof(Coroutine_t));
+    COR_CHECK(fp.cap == 6 && fp.used == 3);
+    COR_CHECK(fp.kernel == sizeof(param) - sizeof(param.stack.pool) && fp.pool == 0 && fp.pool_used == 0);
+    COR_CHECK(fp.stack_pool == COR_STACK_POOL_SIZE && fp.stack_used >= 2 * TEST_STACK);
+    COR_CHECK(fp.stack_used < 2 * TEST_STACK + 256);
+
+    // A freed slot and stack are reused, neither peak moves
+    gone = deep;
+    COR_CHECK(cor_delete_task(&deep));
+    COR_CHECK(cor_stack_high_water(&gone) == 0);
+    COR_CHECK(cor_create_stackful_task(&deep, test_deep, (void *)1, 0, TEST_STACK));
+    cor_footprint_get(&fp);
+    COR_CHECK(fp.used == 3 && fp.stack_used < 2 * TEST_STACK + 256);
+    return cor_test_result("footprint");
+}
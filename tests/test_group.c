@@ -0,0 +1,114 @@
+/**
+ * @file test_group.c
+ * @brief Bulk resume by handles, slot mask or group, group suspend and an event set waking all of its waiters.
+ * @note A table of 64 slots makes groups span two bitmap words.
+ */
+
+#define COROUTINE_MAX_SIZE 64
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_WORKERS 40
+
+static cor_handle_t test_h[TEST_WORKERS];
+static int test_runs[TEST_WORKERS];
+static cor_event_t test_ev = COR_EVENT_INIT;
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Even workers suspend themselves, odd ones wait for the event
+static void test_worker(void *arg)
+{
+    int i = (int)(intptr_t)arg;
+    uint32_t flags;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs[i] += 1;
+        if (i % 2 != 0)
+        {
+            cor_event_wait(&test_ev, 1, COR_EVENT_ANY, COR_WAIT_FOREVER, flags);
+            (void)flags;
+        }
+        else
+        {
+            // Resumed from the top of the loop
+            suspend(NULL);
+            return;
+        }
+    }
+}
+
+// Workers that ran exactly `runs` times among those picked by stride and offset
+static int test_count(int stride, int offset, int runs)
+{
+    int n = 0;
+    for (int i = offset; i < TEST_WORKERS; i += stride)
+    {
+        n += test_runs[i] == runs;
+    }
+    return n;
+}
+
+int main(void)
+{
+    cor_group_t group = COR_GROUP_INIT;
+    uint32_t mask[COR_GROUP_WORDS] = {0};
+    cor_handle_t gone;
+    cor_init(TEST_WORKERS, test_tick);
+    for (int i = 0; i < TEST_WORKERS; i++)
+    {
+        COR_CHECK(cor_create_task(&test_h[i], test_worker, (void *)(intptr_t)i));
+    }
+    cor_run_until_idle();
+    COR_CHECK(test_count(1, 0, 1) == TEST_WORKERS);
+
+    // Only the suspended ones resume, the waiters stay on their event
+    cor_resume_many(test_h, TEST_WORKERS);
+    cor_run_until_idle();
+    COR_CHECK(test_count(2, 0, 2) == TEST_WORKERS / 2 && test_count(2, 1, 1) == TEST_WORKERS / 2);
+
+    // One set wakes every waiter
+    cor_event_set(&test_ev, 1);
+    cor_event_clear(&test_ev, 1);
+    cor_run_until_idle();
+    COR_CHECK(test_count(1, 0, 2) == TEST_WORKERS);
+
+    // Every fourth worker, slots on both sides of 32
+    for (int i = 0; i < TEST_WORKERS; i += 4)
+    {
+        COR_CHECK(cor_group_add(&group, &test_h[i]));
+    }
+    COR_CHECK(group.mask[0] != 0 && group.mask[1] != 0);
+    cor_resume_group(&group);
+    cor_run_until_idle();
+    COR_CHECK(test_count(4, 0, 3) == TEST_WORKERS / 4 && test_count(4, 2, 2) == TEST_WORKERS / 4);
+
+    // Suspended again before they are dispatched
+    cor_resume_group(&group);
+    cor_suspend_group(&group);
+    cor_run_until_idle();
+    COR_CHECK(test_count(4, 0, 3) == TEST_WORKERS / 4);
+
+    mask[(cor_id_t)test_h[2] / 32] |= 1u << ((cor_id_t)test_h[2] % 32);
+    mask[(cor_id_t)test_h[38] / 32] |= 1u << ((cor_id_t)test_h[38] % 32);
+    cor_resume_mask(mask);
+    cor_run_until_idle();
+    COR_CHECK(test_runs[2] == 3 && test_runs[38] == 3 && test_count(4, 2, 2) == TEST_WORKERS / 4 - 2);
+    COR_CHECK(test_count(4, 0, 3) == TEST_WORKERS / 4);
+
+    // Stale handles are skipped by resume and refused by add, remove still clears the slot
+    gone = test_h[0];
+    COR_CHECK(cor_delete_task(&test_h[0]));
+    COR_CHECK(!cor_group_add(&group, &gone));
+    cor_group_remove(&group, &gone);
+    COR_CHECK((group.mask[(cor_id_t)gone / 32] & (1u << ((cor_id_t)gone % 32))) == 0);
+    test_h[0] = gone;
+    cor_resume_many(test_h, 2);
+    cor_run_until_idle();
+    COR_CHECK(test_runs[0] == 3 && test_runs[1] == 2);
+    return cor_test_result("group");
+}
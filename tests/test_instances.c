@@ -0,0 +1,88 @@
+/**
+ * @file test_instances.c
+ * @brief Two scheduler instances keep their own tasks, tables included, and an ISR can notify either one.
+ * @note A pool block freed with the other instance selected still goes back to the instance that carved it.
+ */
+
+#define COR_ENABLE_INSTANCES 1
+#define COR_USE_MALLOC 0
+#define COR_POOL_SIZE 1024
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static int test_runs_a, test_runs_b, test_woken_b;
+static unsigned char test_mem[sizeof(struct cor_sched) + 64] __attribute__((aligned(16)));
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+static void test_yielder(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs_a += 1;
+        cor_yield();
+    }
+}
+
+static void test_waiter(void *arg)
+{
+    static bool ok;
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs_b += 1;
+        cor_notify_wait(COR_WAIT_FOREVER, ok);
+        test_woken_b += ok;
+    }
+}
+
+int main(void)
+{
+    cor_handle_t a, b;
+    cor_sched_t *s;
+    void *block;
+    cor_init(4, test_tick);
+    cor_create_task(&a, test_yielder, NULL);
+    s = cor_sched_create_static(test_mem, sizeof(test_mem));
+    COR_CHECK(s != NULL);
+    cor_sched_use(s);
+    cor_init(4, test_tick);
+    cor_create_task(&b, test_waiter, NULL);
+    COR_CHECK(s->coroutine != cor_sched_default.coroutine);
+    cor_run_until_idle();
+    COR_CHECK(test_runs_b == 1);
+    COR_CHECK(test_runs_a == 0);
+
+    cor_sched_use(NULL);
+    for (int i = 0; i < 5; i++)
+    {
+        cor_run_once();
+    }
+    COR_CHECK(test_runs_a == 5);
+    COR_CHECK(test_runs_b == 1);
+
+    // Posted to s from the default instance, as an ISR would
+    cor_sched_notify_from_isr(s, &b);
+    COR_CHECK(cor_sched_self() != s);
+    cor_sched_use(s);
+    cor_run_until_idle();
+    COR_CHECK(test_runs_b == 2);
+    COR_CHECK(test_woken_b == 1);
+    COR_CHECK(test_runs_a == 5);
+
+    // Carved by s, freed with the default instance selected
+    block = cor_pool_alloc(32);
+    COR_CHECK(block != NULL);
+    cor_sched_use(NULL);
+    cor_pool_free(block);
+    COR_CHECK(cor_pool_alloc(32) != block);
+    cor_sched_use(s);
+    COR_CHECK(cor_pool_alloc(32) == block);
+    return cor_test_result("instances");
+}
@@ -0,0 +1,101 @@
+/**
+ * @file test_layout.c
+ * @brief The timer scan and the dispatcher's pick run on the hot per-task arrays, the task table stays untouched.
+ * @note The table sits in its own page, which is made inaccessible while those paths run.
+ */
+
+#define COROUTINE_MAX_SIZE 128
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_CAP (COROUTINE_MAX_SIZE - 1)
+#define TEST_PAGE 4096
+
+static Coroutine_t test_table[TEST_CAP + 1] __attribute__((aligned(TEST_PAGE)));
+static uint32_t test_now;
+static int test_runs[TEST_CAP + 1];
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_fault(int sig)
+{
+    static const char msg[] = "layout: FAILED, the task table was touched\n";
+    (void)sig;
+    if (write(1, msg, sizeof(msg) - 1) < 0)
+    {
+        // Exiting anyway
+    }
+    _exit(1);
+}
+
+static void test_lock(bool locked)
+{
+    COR_CHECK(mprotect(test_table, sizeof(test_table), locked ? PROT_NONE : PROT_READ | PROT_WRITE) == 0);
+}
+
+// Odd tasks sleep long, even ones yield
+static void test_task(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs[n] += 1;
+        if (n % 2 == 1)
+        {
+            cor_sleep(1000 + (uint32_t)n);
+        }
+        else
+        {
+            cor_yield();
+        }
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    COR_CHECK(sizeof(Coroutine_t) <= 4 * sizeof(void *));
+    COR_CHECK(sizeof(test_table) % TEST_PAGE == 0 && sysconf(_SC_PAGESIZE) == TEST_PAGE);
+    signal(SIGSEGV, test_fault);
+    cor_init_static(test_table, TEST_CAP, test_tick);
+    for (intptr_t n = 1; n <= TEST_CAP; n++)
+    {
+        COR_CHECK(cor_create_task(&h, test_task, (void *)n));
+    }
+    // Every task once, the odd ones are asleep afterwards
+    for (int i = 0; i < TEST_CAP; i++)
+    {
+        COR_CHECK(cor_run_once());
+    }
+
+    test_lock(true);
+    test_now = 500;
+    for (int i = 0; i < 100; i++)
+    {
+        cor_process_time();
+        cor_dispatch();
+        COR_CHECK(COR_CURRID % 2 == 0 && COR_CURRID != 0);
+        // Back into the ready set, as cor_exec would put it after a yield
+        cor_set_state(COR_CURRID, COR_READY);
+    }
+    test_lock(false);
+
+    // Nothing lost while the table was out of reach, every task runs once more
+    test_now = 2000;
+    for (int i = 0; i < TEST_CAP; i++)
+    {
+        COR_CHECK(cor_run_once());
+    }
+    for (int n = 1; n <= TEST_CAP; n++)
+    {
+        COR_CHECK(test_runs[n] == 2);
+    }
+    return cor_test_result("layout");
+}
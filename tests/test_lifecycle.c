@@ -0,0 +1,111 @@
+/**
+ * @file test_lifecycle.c
+ * @brief Exited and deleted tasks free their slot for the next create, their old handles go stale.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_CAP 3
+
+static uint32_t test_now;
+static int test_runs;
+static int test_after_delete;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_once(void *arg)
+{
+    COR_BEGIN();
+    test_runs += 1;
+    cor_task_exit();
+}
+
+static void test_sleeper(void *arg)
+{
+    COR_BEGIN();
+    cor_sleep(10);
+    test_runs += 100;
+    cor_task_exit();
+}
+
+// Deletes itself, the rest of the callback still runs
+static void test_self(void *arg)
+{
+    COR_BEGIN();
+    cor_delete_task(NULL);
+    test_after_delete += 1;
+}
+
+int main(void)
+{
+    cor_handle_t h[TEST_CAP + 1];
+    cor_handle_t old[TEST_CAP];
+    cor_handle_t prev;
+    cor_id_t id = 0;
+    cor_id_t first = 0;
+    bool wrapped = true;
+    cor_init(TEST_CAP, test_tick);
+    for (int n = 0; n < TEST_CAP; n++)
+    {
+        COR_CHECK(cor_create_task(&h[n], test_once, NULL));
+        old[n] = h[n];
+    }
+    COR_CHECK(!cor_create_task(&h[TEST_CAP], test_once, NULL));
+    cor_run_until_idle();
+    COR_CHECK(test_runs == TEST_CAP);
+
+    // The exited slots come back under new handles, the old ones no longer reach them
+    for (int n = 0; n < TEST_CAP; n++)
+    {
+        COR_CHECK(cor_create_task(&h[n], n == 0 ? test_sleeper : test_once, NULL));
+        COR_CHECK(h[n] != old[n] && (cor_id_t)h[n] == (cor_id_t)old[TEST_CAP - 1 - n]);
+    }
+    COR_CHECK(!cor_create_task(&h[TEST_CAP], test_once, NULL));
+    for (int n = 0; n < TEST_CAP; n++)
+    {
+        COR_CHECK(!cor_delete_task(&old[n]));
+        suspend(&old[n]);
+        cor_notify(&old[n]);
+    }
+    cor_run_until_idle();
+    // All but the sleeper are done
+    COR_CHECK(test_runs == TEST_CAP * 2 - 1);
+
+    // A deleted sleeper leaves the sleep queue and never runs
+    COR_CHECK(cor_delete_task(&h[0]) && !cor_delete_task(&h[0]));
+    COR_CHECK(cor_run_until_idle() == COR_WAIT_FOREVER);
+    test_now = 20;
+    cor_run_until_idle();
+    COR_CHECK(test_runs == TEST_CAP * 2 - 1);
+    COR_CHECK(!cor_delete_task(&param.idle));
+
+    COR_CHECK(cor_create_task(&h[0], test_self, NULL) && cor_handle_id(&h[0], &id));
+    cor_run_until_idle();
+    COR_CHECK(test_after_delete == 1 && param.task.state[id] == COR_NONE && !cor_delete_task(&h[0]));
+
+    // One slot recycled past the generation wrap, generation 0 never comes up
+    COR_CHECK(cor_create_task(&prev, test_once, NULL) && cor_handle_id(&prev, &first));
+    for (int i = 0; i < 600; i++)
+    {
+        COR_CHECK(cor_delete_task(&prev));
+        COR_CHECK(cor_create_task(&h[0], test_once, NULL) && cor_handle_id(&h[0], &id));
+        wrapped = wrapped && id == first && (h[0] >> COR_ID_BITS) != 0 && !cor_delete_task(&prev);
+        prev = h[0];
+    }
+    COR_CHECK(wrapped);
+
+    // Re-init after deinit starts over with a full table
+    cor_deinit();
+    cor_init(TEST_CAP, test_tick);
+    for (int n = 0; n < TEST_CAP; n++)
+    {
+        COR_CHECK(cor_create_task(&h[n], test_once, NULL));
+    }
+    cor_run_until_idle();
+    COR_CHECK(test_runs == TEST_CAP * 3 - 1);
+    return cor_test_result("lifecycle");
+}
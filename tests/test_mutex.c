@@ -0,0 +1,76 @@
+/**
+ * @file test_mutex.c
+ * @brief Mutex waiters cost no dispatch while blocked, unlock hands the mutex to the best waiter only.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static muxtex_handle_t test_mutex;
+static cor_id_t test_holder;
+static char test_log[8];
+static int test_len;
+static int test_wrong_owner;
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Keeps the mutex over three turns
+static void test_hold(void *arg)
+{
+    static int turns;
+    COR_BEGIN();
+    cor_mutex_lock(&test_mutex);
+    for (turns = 0; turns < 3; turns++)
+    {
+        cor_yield();
+    }
+    cor_mutex_unlock(&test_mutex);
+    cor_task_exit();
+}
+
+// Owns the mutex by the time it runs again, no retry
+static void test_wait(void *arg)
+{
+    COR_BEGIN();
+    cor_mutex_lock(&test_mutex);
+    test_wrong_owner += test_mutex.owner != COR_CURRID + 1;
+    test_log[test_len++] = (char)(intptr_t)arg;
+    cor_mutex_unlock(&test_mutex);
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_id_t hi = 0;
+    cor_init(8, test_tick);
+    COR_CHECK(cor_create_task(&h, test_hold, NULL) && cor_handle_id(&h, &test_holder));
+    COR_CHECK(cor_create_task(&h, test_wait, (void *)'A'));
+    COR_CHECK(cor_create_task(&h, test_wait, (void *)'B'));
+    COR_CHECK(cor_create_task(&h, test_wait, (void *)'C'));
+    // Holder locks and yields, the three waiters queue in turn
+    for (int i = 0; i < 4; i++)
+    {
+        COR_CHECK(cor_run_once());
+    }
+    COR_CHECK(test_mutex.owner == test_holder + 1);
+    // A higher priority waiter queues last but goes first
+    COR_CHECK(cor_create_task_ex(&h, test_wait, (void *)'H', 1) && cor_handle_id(&h, &hi));
+    COR_CHECK(cor_run_once() && COR_CURRID == hi);
+    COR_CHECK(param.task.state[hi] == COR_BLOCKED);
+
+    // Only the holder is dispatched until it unlocks
+    for (int i = 0; i < 3; i++)
+    {
+        COR_CHECK(cor_run_once() && COR_CURRID == test_holder);
+    }
+    COR_CHECK(test_mutex.owner == hi + 1 && test_len == 0);
+    cor_run_until_idle();
+    test_log[test_len] = '\0';
+    COR_CHECK(strcmp(test_log, "HABC") == 0);
+    COR_CHECK(test_wrong_owner == 0 && test_mutex.owner == 0);
+    return cor_test_result("mutex");
+}
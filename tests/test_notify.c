@@ -0,0 +1,116 @@
+/**
+ * @file test_notify.c
+ * @brief Notifications from an interrupt reach their task at the next dispatch, none is lost.
+ * @note SIGALRM stands in for the interrupt, it fires every 100 us while the scheduler runs.
+ */
+
+#define COROUTINE_MAX_SIZE 64
+#include <signal.h>
+#include <sys/time.h>
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_TASKS 40
+#define TEST_ROUNDS 20
+
+static cor_handle_t test_h[TEST_TASKS];
+static volatile uint32_t test_woke[TEST_TASKS];
+static volatile uint32_t test_posted[TEST_TASKS];
+static volatile uint32_t test_next;
+static int test_timeouts;
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Posts to the next task that handled its last notification, so posts never merge
+static void test_isr(int sig)
+{
+    uint32_t n = test_next;
+    (void)sig;
+    if (test_posted[n] == test_woke[n] && test_woke[n] < TEST_ROUNDS)
+    {
+        test_posted[n] += 1;
+        cor_notify_from_isr(&test_h[n]);
+    }
+    test_next = (n + 1) % TEST_TASKS;
+}
+
+static void test_waiter(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    bool ok;
+    COR_BEGIN();
+    while (test_woke[n] < TEST_ROUNDS)
+    {
+        cor_notify_wait(COR_WAIT_FOREVER, ok);
+        test_timeouts += !ok;
+        test_woke[n] += 1;
+    }
+    cor_task_exit();
+}
+
+// Waits once, the notification can come before it gets there
+static void test_once(void *arg)
+{
+    bool ok;
+    COR_BEGIN();
+    cor_notify_wait(COR_WAIT_FOREVER, ok);
+    *(int *)arg = ok ? 1 : -1;
+    cor_task_exit();
+}
+
+int main(void)
+{
+    struct itimerval timer = {{0, 100}, {0, 100}};
+    cor_handle_t h;
+    cor_id_t id = 0;
+    int done = 0;
+    cor_init(TEST_TASKS + 1, test_tick);
+
+    // Posted, folded in by the next dispatch, which runs the waiter
+    COR_CHECK(cor_create_task(&h, test_once, &done) && cor_handle_id(&h, &id));
+    cor_run_until_idle();
+    COR_CHECK(param.task.state[id] == COR_BLOCKED);
+    cor_notify_from_isr(&h);
+    COR_CHECK(param.task.state[id] == COR_BLOCKED && cor_wakeup_pending());
+    COR_CHECK(cor_run_once() && COR_CURRID == id && done == 1);
+    // Posted before the task waits, the notification is latched for cor_notify_wait
+    done = 0;
+    COR_CHECK(cor_create_task(&h, test_once, &done));
+    cor_notify_from_isr(&h);
+    cor_run_until_idle();
+    COR_CHECK(done == 1);
+    // A stale handle is ignored
+    cor_notify_from_isr(&h);
+    COR_CHECK(!cor_wakeup_pending());
+
+    for (intptr_t n = 0; n < TEST_TASKS; n++)
+    {
+        COR_CHECK(cor_create_task(&test_h[n], test_waiter, (void *)n));
+    }
+    signal(SIGALRM, test_isr);
+    setitimer(ITIMER_REAL, &timer, NULL);
+    for (;;)
+    {
+        uint32_t total = 0;
+        cor_run_until_idle();
+        for (int n = 0; n < TEST_TASKS; n++)
+        {
+            total += test_woke[n];
+        }
+        if (total == TEST_TASKS * TEST_ROUNDS)
+        {
+            break;
+        }
+    }
+    timer.it_value.tv_usec = 0;
+    setitimer(ITIMER_REAL, &timer, NULL);
+    COR_CHECK(test_timeouts == 0);
+    for (int n = 0; n < TEST_TASKS; n++)
+    {
+        COR_CHECK(test_woke[n] == TEST_ROUNDS && test_posted[n] == TEST_ROUNDS);
+    }
+    return cor_test_result("notify");
+}
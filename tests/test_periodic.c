@@ -0,0 +1,66 @@
+/**
+ * @file test_periodic.c
+ * @brief A job that ends at its next release is on time, and a reused slot starts without the old overruns.
+ */
+
+#define COR_ENABLE_SIM 1
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static int test_runs;
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Each job takes exactly its period
+static void test_exact(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_runs += 1;
+        cor_sim_advance(10);
+        cor_periodic(10);
+    }
+}
+
+// Each job takes two and a half periods
+static void test_late(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_sim_advance(25);
+        cor_periodic(10);
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(4, test_tick);
+    cor_sim_start(1000, 1);
+    cor_create_task(&h, test_exact, NULL);
+    cor_run_for(1000);
+    COR_CHECK(test_runs == 100);
+    COR_CHECK(cor_get_overruns(&h, false) == 0);
+    COR_CHECK(cor_delete_task(&h));
+
+    cor_create_task(&h, test_late, NULL);
+    cor_run_for(100);
+    COR_CHECK(cor_get_overruns(&h, false) > 0);
+    COR_CHECK(cor_delete_task(&h));
+
+    // Same slot, fresh loop
+    test_runs = 0;
+    cor_create_task(&h, test_exact, NULL);
+    COR_CHECK(cor_get_overruns(&h, false) == 0);
+    cor_run_for(100);
+    COR_CHECK(test_runs == 10);
+    COR_CHECK(cor_get_overruns(&h, false) == 0);
+    return cor_test_result("periodic");
+}
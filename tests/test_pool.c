@@ -0,0 +1,88 @@
+/**
+ * @file test_pool.c
+ * @brief Task contexts and blocks come from size classed freelists, a freed block is reused by its own class only.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#define COR_POOL_SIZE 2048
+#include "../coroutine.c"
+#include "cor_test.h"
+
+typedef struct
+{
+    int runs;
+    char name[40];
+} test_session_t;
+
+static uint32_t test_now;
+static int test_dirty;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+// Finds its context zeroed, scribbles over it and ends after a short sleep
+static void test_session(void *arg)
+{
+    test_session_t *s = arg;
+    COR_BEGIN();
+    test_dirty += s->runs != 0 || s->name[0] != 0;
+    s->runs += 1;
+    memset(s->name, 'x', sizeof(s->name));
+    cor_sleep(2);
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h, keep;
+    cor_footprint_t fp;
+    void *first = NULL;
+    void *again = NULL;
+    void *a, *b, *c;
+    uint32_t used;
+    int sessions = 0;
+    cor_init(COROUTINE_MAX_SIZE - 1, test_tick);
+
+    COR_CHECK(cor_create_task_ctx(&h, test_session, sizeof(test_session_t), 0, &first));
+    COR_CHECK(((uintptr_t)first & (COR_POOL_ALIGN - 1)) == 0);
+    for (test_now = 0; test_now < 5; test_now++)
+    {
+        cor_run_until_idle();
+    }
+    // The exited session's context is handed to the next one of the same size, zeroed again
+    COR_CHECK(cor_create_task_ctx(&h, test_session, sizeof(test_session_t), 0, &again) && again == first);
+    COR_CHECK(cor_delete_task(&h));
+    cor_footprint_get(&fp);
+    used = fp.pool_used;
+    COR_CHECK(cor_create_task_ctx(&keep, test_session, sizeof(test_session_t), 0, &again) && again == first);
+    cor_footprint_get(&fp);
+    COR_CHECK(fp.pool_used == used);
+
+    // Size limits, and a freed block only serves its own class
+    COR_CHECK(cor_pool_alloc((size_t)16 << COR_POOL_CLASSES) == NULL);
+    a = cor_pool_alloc(100);
+    COR_CHECK(a != NULL);
+    cor_pool_free(a);
+    b = cor_pool_alloc(30);
+    c = cor_pool_alloc(120);
+    COR_CHECK(b != a && c == a);
+    cor_pool_free(b);
+    cor_pool_free(c);
+    cor_pool_free(NULL);
+
+    // Exhausted by contexts, not by the task table
+    while (cor_create_task_ctx(&h, test_session, sizeof(test_session_t), 0, NULL))
+    {
+        sessions += 1;
+    }
+    cor_footprint_get(&fp);
+    COR_CHECK(sessions > 10 && sessions < COROUTINE_MAX_SIZE - 3 && fp.pool == COR_POOL_SIZE && fp.pool_used <= fp.pool);
+    for (test_now = 5; test_now < 10; test_now++)
+    {
+        cor_run_until_idle();
+    }
+    COR_CHECK(test_dirty == 0);
+    return cor_test_result("pool");
+}
@@ -0,0 +1,101 @@
+/**
+ * @file test_prio.c
+ * @brief The highest ready level always runs first, tasks of one level take turns.
+ * @note The tick is stepped by hand, each task logs a letter every time it runs.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_LOG 64
+
+static uint32_t test_now;
+static char test_log[TEST_LOG + 1];
+static int test_len;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_note(char c)
+{
+    if (test_len < TEST_LOG)
+    {
+        test_log[test_len++] = c;
+    }
+}
+
+// High level, two turns then a 10 ms sleep, twice
+static void test_high(void *arg)
+{
+    static int turns[2];
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    for (turns[n] = 0; turns[n] < 4; turns[n]++)
+    {
+        test_note((char)('A' + n));
+        if (turns[n] % 2 == 1)
+        {
+            cor_sleep(10);
+        }
+        else
+        {
+            cor_yield();
+        }
+    }
+    cor_task_exit();
+}
+
+// Middle level, three turns then done
+static void test_mid(void *arg)
+{
+    static int turns;
+    COR_BEGIN();
+    for (turns = 0; turns < 3; turns++)
+    {
+        test_note('m');
+        cor_yield();
+    }
+    cor_task_exit();
+}
+
+// Lowest level, never blocks
+static void test_low(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        test_note((char)('x' + n));
+        cor_yield();
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(8, test_tick);
+    // Created lowest first, so the order of creation cannot explain the result
+    COR_CHECK(cor_create_task_ex(&h, test_low, (void *)0, 0));
+    COR_CHECK(cor_create_task_ex(&h, test_low, (void *)1, 0));
+    COR_CHECK(cor_create_task_ex(&h, test_mid, NULL, 1));
+    COR_CHECK(cor_create_task_ex(&h, test_high, (void *)0, COR_PRIO_LEVELS - 1));
+    COR_CHECK(cor_create_task_ex(&h, test_high, (void *)1, COR_PRIO_LEVELS - 1));
+    COR_CHECK(!cor_create_task_ex(&h, test_low, (void *)2, COR_PRIO_LEVELS));
+
+    // The fourth pass of the middle task only ends it
+    for (int i = 0; i < 11; i++)
+    {
+        COR_CHECK(cor_run_once());
+    }
+    // A due sleeper preempts the low level at the next dispatch
+    test_now = 10;
+    for (int i = 0; i < 7; i++)
+    {
+        COR_CHECK(cor_run_once());
+    }
+    test_log[test_len] = '\0';
+    COR_CHECK(strcmp(test_log, "ABABmmmxyxABAByxy") == 0);
+    return cor_test_result("prio");
+}
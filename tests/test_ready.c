@@ -0,0 +1,94 @@
+/**
+ * @file test_ready.c
+ * @brief Ready tasks spread over several bitmap words take turns in order, suspended ones are never picked.
+ */
+
+#define COROUTINE_MAX_SIZE 128
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_TASKS 100
+
+static int test_runs[TEST_TASKS + 1];
+static cor_id_t test_order[TEST_TASKS * 2];
+static int test_count;
+static bool test_parked[TEST_TASKS + 1];
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+static void test_spin(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    // Every third task takes itself out of the ready sets on its first run
+    if (n % 3 == 0 && !test_parked[n])
+    {
+        test_parked[n] = true;
+        suspend(NULL);
+        return;
+    }
+    for (;;)
+    {
+        test_runs[n] += 1;
+        if (test_count < TEST_TASKS * 2)
+        {
+            test_order[test_count++] = (cor_id_t)n;
+        }
+        cor_yield();
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h[TEST_TASKS + 1];
+    int ready = 0;
+    cor_init(TEST_TASKS + 1, test_tick);
+    for (intptr_t n = 1; n <= TEST_TASKS; n++)
+    {
+        COR_CHECK(cor_create_task(&h[n], test_spin, (void *)n));
+    }
+    for (int n = 1; n <= TEST_TASKS; n++)
+    {
+        ready += n % 3 != 0;
+    }
+    // One pass to let the suspended tasks park, then five full rounds
+    for (int i = 0; i < TEST_TASKS + ready * 5; i++)
+    {
+        COR_CHECK(cor_run_once());
+    }
+    for (int n = 1; n <= TEST_TASKS; n++)
+    {
+        COR_CHECK(test_runs[n] == (n % 3 == 0 ? 0 : 6));
+    }
+    // Round robin: each pass visits the ready tasks in the same order
+    for (int i = 0; i + ready < test_count; i++)
+    {
+        COR_CHECK(test_order[i] == test_order[i + ready]);
+    }
+
+    // Resumed tasks join the rotation, and nothing else runs once all are suspended
+    cor_resume(&h[99]);
+    test_runs[99] = 0;
+    for (int i = 0; i < ready + 1; i++)
+    {
+        cor_run_once();
+    }
+    COR_CHECK(test_runs[99] == 1 && test_runs[98] == 7);
+    for (int n = 1; n <= TEST_TASKS; n++)
+    {
+        suspend(&h[n]);
+    }
+    COR_CHECK(!cor_run_once());
+
+    // A task suspended before it ever ran starts from the top once resumed, this one does not park itself
+    test_parked[0] = true;
+    COR_CHECK(cor_create_task(&h[0], test_spin, (void *)0));
+    suspend(&h[0]);
+    COR_CHECK(!cor_run_once());
+    cor_resume(&h[0]);
+    COR_CHECK(cor_run_once() && test_runs[0] == 1);
+    return cor_test_result("ready");
+}
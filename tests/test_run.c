@@ -0,0 +1,61 @@
+/**
+ * @file test_run.c
+ * @brief cor_run_once, cor_run_until_idle and cor_run_for give control back to the caller's loop.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static uint32_t test_now;
+static bool test_running;
+static int test_wakes;
+
+// Free running while cor_run_for spins, so its end tick comes
+static uint32_t test_tick(void)
+{
+    return test_running ? test_now++ : test_now;
+}
+
+static void test_sleeper(void *arg)
+{
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_sleep(30);
+        test_wakes += 1;
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    uint32_t start;
+    COR_CHECK(!cor_run_once() && !cor_run_for(10) && cor_run_until_idle() == COR_WAIT_FOREVER);
+    cor_init(4, test_tick);
+    COR_CHECK(cor_create_task(&h, test_sleeper, NULL));
+    // The first step readies the created task and runs it into its sleep, the next one is idle
+    COR_CHECK(cor_run_once());
+    COR_CHECK(!cor_run_once());
+    COR_CHECK(cor_run_until_idle() == 30);
+    test_now = 10;
+    COR_CHECK(cor_run_until_idle() == 20 && test_wakes == 0);
+
+    // A host loop that blocks for exactly the time handed back, one wake per pass
+    for (int i = 0; i < 5; i++)
+    {
+        test_now += cor_run_until_idle();
+        COR_CHECK(cor_run_until_idle() == 30 && test_wakes == i + 1);
+    }
+    COR_CHECK(test_now == 150);
+
+    // Sleeps due 30, 60 and 90 ticks in fall inside the slice, the next one does not
+    test_running = true;
+    start = test_now;
+    COR_CHECK(cor_run_for(100));
+    test_running = false;
+    COR_CHECK(test_now - start >= 100 && test_now - start < 120);
+    COR_CHECK(test_wakes == 8);
+    COR_CHECK(cor_delete_task(&h));
+    COR_CHECK(cor_run_until_idle() == COR_WAIT_FOREVER);
+    return cor_test_result("run");
+}
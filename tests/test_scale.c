@@ -0,0 +1,63 @@
+/**
+ * @file test_scale.c
+ * @brief A thousand tasks, well past the old 31 task ceiling, share one mutex and all finish.
+ */
+
+#define COROUTINE_MAX_SIZE 1024
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_TASKS 1000
+
+static muxtex_handle_t test_mutex;
+static int test_inside;
+static int test_overlap;
+static int test_done;
+static bool test_ran[TEST_TASKS];
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Holds the mutex across a yield, the others have to queue behind it
+static void test_worker(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    cor_mutex_lock(&test_mutex);
+    test_inside += 1;
+    test_overlap += test_inside > 1;
+    cor_yield();
+    test_ran[n] = true;
+    test_inside -= 1;
+    cor_mutex_unlock(&test_mutex);
+    test_done += 1;
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h[TEST_TASKS + 1];
+    cor_id_t id;
+    COR_CHECK(sizeof(cor_id_t) == 2 && sizeof(cor_handle_t) == 4);
+    // COROUTINE_MAX_SIZE counts the idle task, the cap does not
+    COR_CHECK(!cor_init(COROUTINE_MAX_SIZE, test_tick));
+    COR_CHECK(cor_init(TEST_TASKS, test_tick));
+    for (intptr_t n = 0; n < TEST_TASKS; n++)
+    {
+        COR_CHECK(cor_create_task(&h[n], test_worker, (void *)n));
+    }
+    // Full table, and ids past 255 still come back from their handles
+    COR_CHECK(!cor_create_task(&h[TEST_TASKS], test_worker, NULL));
+    COR_CHECK(cor_handle_id(&h[TEST_TASKS - 1], &id) && id == TEST_TASKS);
+
+    cor_run_until_idle();
+    COR_CHECK(test_done == TEST_TASKS && test_overlap == 0 && test_inside == 0);
+    COR_CHECK(test_mutex.owner == 0);
+    for (int n = 0; n < TEST_TASKS; n++)
+    {
+        COR_CHECK(test_ran[n]);
+    }
+    return cor_test_result("scale");
+}
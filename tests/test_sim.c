@@ -0,0 +1,91 @@
+/**
+ * @file test_sim.c
+ * @brief Under the virtual clock a run is fixed by its seed: no wakeup comes early and the same seed replays the same schedule.
+ * @note An hour of simulated time passes without waiting, the tick source of cor_init is never read.
+ */
+
+#define COR_ENABLE_SIM 1
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_TASKS 8
+
+static cor_tick_t test_due[TEST_TASKS];
+static uint32_t test_reads;
+static uint32_t test_runs;
+static uint64_t test_hash;
+
+static uint32_t test_tick(void)
+{
+    // The virtual clock replaces it
+    test_reads += 1;
+    return 0;
+}
+
+// Sleeps a random time, checks when it wakes and accounts for a little work now and then
+static void test_sleeper(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    cor_tick_t now;
+    uint32_t ms;
+    COR_BEGIN();
+    for (;;)
+    {
+        now = cor_get_tick();
+        // Never early, late only by the work of a task due on the same tick
+        COR_CHECK(now - test_due[n] <= 1);
+        test_runs += 1;
+        test_hash = (test_hash ^ (now * 31u + (uint64_t)n)) * 1099511628211ull;
+        if (test_runs % 16 == 0)
+        {
+            cor_sim_advance(1);
+        }
+        // The clock stood still but for the work accounted, the sleep counts from the dispatch
+        COR_CHECK(cor_get_tick() == now + (test_runs % 16 == 0));
+        ms = 100 + cor_sim_random() % 900;
+        test_due[n] = now + ms;
+        cor_sleep(ms);
+    }
+}
+
+// One simulated hour from a fresh scheduler, the hash folds in every wakeup
+static uint64_t test_simulate(uint32_t seed)
+{
+    cor_handle_t h[TEST_TASKS];
+    bool ok = true;
+    test_runs = 0;
+    test_hash = 1469598103934665603ull;
+    ok = ok && cor_init(TEST_TASKS, test_tick);
+    ok = ok && cor_sim_start(1000, seed);
+    for (intptr_t n = 0; n < TEST_TASKS; n++)
+    {
+        test_due[n] = 0;
+        ok = ok && cor_create_task(&h[n], test_sleeper, (void *)n);
+    }
+    ok = ok && cor_run_for(3600u * 1000u);
+    COR_CHECK(ok && cor_get_tick() == 3600u * 1000u);
+    // Roughly one wakeup per task every 550 ms
+    COR_CHECK(test_runs > TEST_TASKS * 3600 && test_runs < TEST_TASKS * 3600 * 10);
+    for (int n = 0; n < TEST_TASKS; n++)
+    {
+        cor_delete_task(&h[n]);
+    }
+    // Out of events, cor_run gives up instead of waiting forever
+    COR_CHECK(cor_run());
+    cor_deinit();
+    return test_hash;
+}
+
+int main(void)
+{
+    uint64_t first, again, other;
+    uint32_t runs;
+    first = test_simulate(1);
+    runs = test_runs;
+    again = test_simulate(1);
+    COR_CHECK(first == again && runs == test_runs);
+    other = test_simulate(2);
+    COR_CHECK(other != first);
+    COR_CHECK(test_reads == 0);
+    return cor_test_result("sim");
+}
@@ -0,0 +1,55 @@
+/**
+ * @file test_sleep.c
+ * @brief Many sleepers wake exactly at their own deadlines, whatever the order they went to sleep in.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_TASKS 24
+
+static uint32_t test_now;
+static uint32_t test_woke[TEST_TASKS];
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+// Sleeps a scrambled delay, 10 to 240 ms, once
+static void test_sleeper(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    cor_sleep((uint32_t)((n * 7 % TEST_TASKS) + 1) * 10);
+    test_woke[n] = test_now;
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h[TEST_TASKS];
+    cor_tick_t deadline;
+    cor_init(TEST_TASKS, test_tick);
+    for (intptr_t n = 0; n < TEST_TASKS; n++)
+    {
+        COR_CHECK(cor_create_task(&h[n], test_sleeper, (void *)n));
+    }
+    cor_run_until_idle();
+    COR_CHECK(cor_next_deadline(&deadline) && deadline == 10);
+
+    // A sleeper deleted before its deadline leaves the queue
+    COR_CHECK(cor_delete_task(&h[1]));
+    for (test_now = 1; test_now <= 300; test_now++)
+    {
+        cor_run_until_idle();
+    }
+    for (intptr_t n = 0; n < TEST_TASKS; n++)
+    {
+        uint32_t due = (uint32_t)((n * 7 % TEST_TASKS) + 1) * 10;
+        COR_CHECK(test_woke[n] == (n == 1 ? 0 : due));
+    }
+    COR_CHECK(!cor_next_deadline(&deadline));
+    return cor_test_result("sleep");
+}
@@ -0,0 +1,91 @@
+/**
+ * @file test_spsc.c
+ * @brief Messages pass through an SPSC ring in order, and a deleted consumer is not woken through its old slot.
+ */
+
+#define COR_ENABLE_SIM 1
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static void *test_buf[4];
+static cor_spsc_t test_ring = COR_SPSC_INIT(test_buf, 4);
+static intptr_t test_got[10];
+static int test_count;
+static int test_woken, test_timeouts;
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+static void test_consumer(void *arg)
+{
+    static void *msg;
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_spsc_recv(&test_ring, msg);
+        test_got[test_count++] = (intptr_t)msg;
+    }
+}
+
+// Takes over the slot of the deleted consumer and waits for a notification of its own
+static void test_other(void *arg)
+{
+    static bool ok;
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_notify_wait(50, ok);
+        test_woken += ok ? 1 : 0;
+        test_timeouts += ok ? 0 : 1;
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h, old;
+    cor_init(4, test_tick);
+    cor_sim_start(1000, 1);
+    cor_create_task(&h, test_consumer, NULL);
+    cor_run_until_idle();
+    COR_CHECK(test_ring.consumer == h);
+    for (intptr_t i = 1; i <= 6; i++)
+    {
+        COR_CHECK(cor_spsc_push(&test_ring, (void *)i));
+        if (i % 3 == 0)
+        {
+            cor_run_until_idle();
+        }
+    }
+    COR_CHECK(test_count == 6);
+    for (int i = 0; i < 6; i++)
+    {
+        COR_CHECK(test_got[i] == i + 1);
+    }
+
+    // Full ring refuses further messages
+    for (intptr_t i = 0; i < 4; i++)
+    {
+        COR_CHECK(cor_spsc_push(&test_ring, (void *)i));
+    }
+    COR_CHECK(!cor_spsc_push(&test_ring, (void *)4));
+    cor_run_until_idle();
+    COR_CHECK(test_count == 10);
+
+    old = h;
+    COR_CHECK(cor_delete_task(&h));
+    COR_CHECK(test_ring.consumer == 0);
+    cor_create_task(&h, test_other, NULL);
+    COR_CHECK((h & ((1u << COR_ID_BITS) - 1)) == (old & ((1u << COR_ID_BITS) - 1)));
+    cor_run_until_idle();
+    // A stale consumer left behind must not reach the new task either
+    test_ring.consumer = old;
+    COR_CHECK(cor_spsc_push(&test_ring, (void *)9));
+    cor_run_for(100);
+    COR_CHECK(test_woken == 0);
+    COR_CHECK(test_timeouts >= 1);
+    return cor_test_result("spsc");
+}
@@ -0,0 +1,93 @@
+/**
+ * @file test_stackful.c
+ * @brief Stackful tasks wait from deep inside their call chain next to stackless ones, locals survive every wait.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#define COR_ENABLE_STACKFUL 1
+#define COR_STACK_POOL_SIZE 65536
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_STACK 16000
+
+static uint32_t test_now;
+static cor_sem_t test_sem = COR_SEM_INIT(0);
+static void *test_buf[2];
+static cor_chan_t test_chan = COR_CHAN_INIT(test_buf, 2);
+static int test_sum[3];
+static uint32_t test_sum_at[3];
+static uint32_t test_sem_at[3];
+static int test_got[3];
+static uint32_t test_recv_at[3];
+static int test_ended;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+// Sleeps at the bottom of the recursion, returns acc plus twice 1 + ... + n
+static int test_depth(int n, int acc)
+{
+    volatile char pad[64];
+    pad[0] = (char)n;
+    if (n == 0)
+    {
+        cor_stack_sleep(10);
+        return acc + pad[0];
+    }
+    return test_depth(n - 1, acc + n) + pad[0];
+}
+
+static void test_deep(void *arg)
+{
+    int local = (int)(intptr_t)arg;
+    void *msg = NULL;
+    test_sum[local] = test_depth(5, local * 100);
+    test_sum_at[local] = test_now;
+    cor_stack_sem_take(&test_sem, 1000);
+    test_sem_at[local] = test_now;
+    test_got[local] = cor_stack_chan_recv(&test_chan, &msg, 50) ? (int)(intptr_t)msg : -1;
+    test_recv_at[local] = test_now;
+    test_ended += local;
+}
+
+static void test_plain(void *arg)
+{
+    COR_BEGIN();
+    cor_sleep(30);
+    cor_sem_give(&test_sem);
+    cor_sem_give(&test_sem);
+    cor_chan_send(&test_chan, (void *)7);
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(8, test_tick);
+    COR_CHECK(cor_create_stackful_task(&h, test_deep, (void *)1, 0, TEST_STACK));
+    COR_CHECK(cor_create_stackful_task(&h, test_deep, (void *)2, 0, TEST_STACK));
+    // More than what is left of the pool
+    COR_CHECK(!cor_create_stackful_task(&h, test_deep, NULL, 0, COR_STACK_POOL_SIZE - TEST_STACK));
+    COR_CHECK(cor_create_task(&h, test_plain, NULL));
+    cor_run_until_idle();
+    for (test_now = 1; test_now <= 100; test_now++)
+    {
+        cor_run_until_idle();
+    }
+    COR_CHECK(test_sum[1] == 130 && test_sum[2] == 230 && test_sum_at[1] == 10 && test_sum_at[2] == 10);
+    COR_CHECK(test_sem_at[1] == 30 && test_sem_at[2] == 30);
+    // One message, the first receiver takes it and the second times out
+    COR_CHECK(test_got[1] == 7 && test_recv_at[1] == 30);
+    COR_CHECK(test_got[2] == -1 && test_recv_at[2] == 80);
+    COR_CHECK(test_ended == 3);
+
+    // The stacks of the ended tasks are handed out again
+    COR_CHECK(cor_create_stackful_task(&h, test_deep, (void *)1, 0, TEST_STACK));
+    COR_CHECK(cor_create_stackful_task(&h, test_deep, (void *)2, 0, TEST_STACK));
+    COR_CHECK(cor_delete_task(&h));
+    COR_CHECK(cor_create_stackful_task(&h, test_deep, (void *)2, 0, TEST_STACK));
+    return cor_test_result("stackful");
+}
@@ -0,0 +1,70 @@
+/**
+ * @file test_static.c
+ * @brief With COR_USE_MALLOC 0 tasks live in the caller's table or the linker placed one, the heap is never touched.
+ */
+
+#define COR_USE_MALLOC 0
+#define COROUTINE_MAX_SIZE 8
+#include <stdlib.h>
+// Any heap call left in the library would show up here
+static int test_heap;
+#define malloc(size) (test_heap += 1, (void *)0)
+#define free(ptr) (test_heap += 1, (void)(ptr))
+#include "../coroutine.c"
+#undef malloc
+#undef free
+#include "cor_test.h"
+
+COR_STATIC_TABLE(test_table, 4);
+
+static int test_runs[4];
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+static void test_task(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    COR_BEGIN();
+    test_runs[n] += 1;
+    cor_yield();
+    test_runs[n] += 1;
+    cor_task_exit();
+}
+
+static void test_round(void)
+{
+    cor_handle_t h;
+    for (intptr_t n = 0; n < 4; n++)
+    {
+        COR_CHECK(cor_create_task(&h, test_task, (void *)n));
+    }
+    COR_CHECK(!cor_create_task(&h, test_task, NULL));
+    cor_run_until_idle();
+    for (int n = 0; n < 4; n++)
+    {
+        COR_CHECK(test_runs[n] == 2);
+        test_runs[n] = 0;
+    }
+}
+
+int main(void)
+{
+    COR_CHECK(sizeof(test_table) == 5 * sizeof(Coroutine_t));
+    // Caller owned table, the tasks are kept in it
+    COR_CHECK(!cor_init_static(test_table, COROUTINE_MAX_SIZE, test_tick));
+    COR_CHECK(cor_init_static(test_table, 4, test_tick));
+    COR_CHECK(param.coroutine == test_table);
+    test_round();
+    cor_deinit();
+
+    // cor_init falls back to the table inside the scheduler
+    COR_CHECK(cor_init(4, test_tick));
+    COR_CHECK(param.coroutine == param.table);
+    test_round();
+    cor_deinit();
+    COR_CHECK(test_heap == 0);
+    return cor_test_result("static");
+}
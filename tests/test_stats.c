@@ -0,0 +1,63 @@
+/**
+ * @file test_stats.c
+ * @brief Run counts, time inside the callback and ready to running latency are kept per task.
+ * @note COR_CYCLES() reads a counter that only the tasks and the test move.
+ */
+
+#define COR_ENABLE_STATS 1
+#define COR_CYCLES() test_cycles
+#include <stdint.h>
+static uint32_t test_cycles;
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// Three runs of 10, 20 and 30 cycles, then 5 per notification
+static void test_worker(void *arg)
+{
+    static int turns;
+    bool ok;
+    COR_BEGIN();
+    for (turns = 1; turns <= 3; turns++)
+    {
+        test_cycles += 10 * turns;
+        cor_yield();
+    }
+    for (;;)
+    {
+        cor_notify_wait(COR_WAIT_FOREVER, ok);
+        test_cycles += ok ? 5 : 0;
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h, gone;
+    cor_stats_t st;
+    cor_init(4, test_tick);
+    COR_CHECK(cor_create_task(&h, test_worker, NULL));
+    cor_run_until_idle();
+    // The fourth run only parks the task
+    COR_CHECK(cor_stats_get(&h, &st));
+    COR_CHECK(st.runs == 4 && st.cycles == 60 && st.max_cycles == 30 && st.max_latency == 0);
+
+    // Readied, then left waiting 40 cycles before it is dispatched
+    cor_notify(&h);
+    test_cycles += 40;
+    COR_CHECK(cor_run_once());
+    COR_CHECK(cor_stats_get(&h, &st));
+    COR_CHECK(st.runs == 5 && st.cycles == 65 && st.max_cycles == 30 && st.max_latency == 40);
+
+    cor_stats_reset(&h);
+    COR_CHECK(cor_stats_get(&h, &st));
+    COR_CHECK(st.runs == 0 && st.cycles == 0 && st.max_cycles == 0 && st.max_latency == 0);
+    // No counters behind a stale handle
+    gone = h;
+    COR_CHECK(cor_delete_task(&h));
+    COR_CHECK(!cor_stats_get(&gone, &st));
+    return cor_test_result("stats");
+}
@@ -0,0 +1,50 @@
+/**
+ * @file test_steal.c
+ * @brief A task dispatched on one core is not stolen by another before it has run.
+ * @note Both cores are driven from one thread, COR_CORE_ID() reads test_core.
+ */
+
+#define COR_NUM_CORES 2
+#define COR_CORE_ID() test_core
+static unsigned test_core;
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+static void test_spin(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_yield();
+    }
+}
+
+int main(void)
+{
+    cor_handle_t a, b;
+    cor_id_t first, second;
+    cor_init(4, test_tick);
+    cor_create_task(&a, test_spin, NULL);
+    cor_create_task(&b, test_spin, NULL);
+    cor_start();
+    // Both tasks ready on core 0, core 1 idle and free to steal
+    cor_migrate(1, 0);
+    cor_migrate(2, 0);
+    test_core = 0;
+    cor_dispatch();
+    first = COR_CURRID;
+    test_core = 1;
+    cor_dispatch();
+    second = COR_CURRID;
+    COR_CHECK(first != 0);
+    COR_CHECK(second != 0);
+    COR_CHECK(first != second);
+    COR_CHECK(param.task.state[first] == COR_RUNNING);
+    return cor_test_result("steal");
+}
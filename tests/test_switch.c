@@ -0,0 +1,100 @@
+/**
+ * @file test_switch.c
+ * @brief With COR_USE_SWITCH tasks and child routines resume through a switch, and behave as with label addresses.
+ * @note -Wpedantic is an error here, so any label address left in the switch build fails to compile.
+ */
+
+#pragma GCC diagnostic error "-Wpedantic"
+#define COR_USE_SWITCH 1
+#include "../coroutine.c"
+#include "cor_test.h"
+
+typedef struct
+{
+    cor_child_t cor;
+    int i;
+} test_child_t;
+
+COR_CHILD_DEPTH(test_blink, 1);
+
+static uint32_t test_now;
+static cor_mutex_t test_mutex = COR_MUTEX_INIT;
+static cor_sem_t test_sem = COR_SEM_INIT(0);
+static test_child_t test_ctx;
+static char test_log[32];
+static int test_len;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_note(char c)
+{
+    if (test_len < (int)sizeof(test_log) - 1)
+    {
+        test_log[test_len++] = c;
+    }
+}
+
+// Sleeps three times on behalf of its task
+static void test_blink(test_child_t *ctx)
+{
+    COR_CHILD_BEGIN(test_blink, ctx);
+    for (ctx->i = 0; ctx->i < 3; ctx->i++)
+    {
+        cor_child_sleep(10);
+        test_note('c');
+    }
+    COR_CHILD_END();
+}
+
+static void test_a(void *arg)
+{
+    static int i;
+    bool ok;
+    COR_BEGIN();
+    cor_mutex_lock(&test_mutex);
+    for (i = 0; i < 2; i++)
+    {
+        test_note('a');
+        cor_yield();
+    }
+    cor_mutex_unlock(&test_mutex);
+    cor_child_call(test_blink, &test_ctx);
+    cor_sem_take_timeout(&test_sem, 100, ok);
+    test_note(ok ? 'S' : 's');
+    cor_task_exit();
+    COR_END();
+}
+
+static void test_b(void *arg)
+{
+    COR_BEGIN();
+    cor_mutex_lock(&test_mutex);
+    test_note('b');
+    cor_mutex_unlock(&test_mutex);
+    cor_sleep(50);
+    cor_sem_give(&test_sem);
+    test_note('g');
+    cor_task_exit();
+    COR_END();
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(4, test_tick);
+    COR_CHECK(cor_create_task(&h, test_a, NULL));
+    COR_CHECK(cor_create_task(&h, test_b, NULL));
+    cor_run_until_idle();
+    for (test_now = 1; test_now <= 200; test_now++)
+    {
+        cor_run_until_idle();
+    }
+    test_log[test_len] = '\0';
+    // b waits for the mutex behind a's two turns, then a's child sleeps while b sleeps
+    COR_CHECK(strcmp(test_log, "aabcccgS") == 0);
+    COR_CHECK(cor_run_until_idle() == COR_WAIT_FOREVER);
+    return cor_test_result("switch");
+}
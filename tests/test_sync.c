@@ -0,0 +1,100 @@
+/**
+ * @file test_sync.c
+ * @brief Semaphore and event flag waiters wake exactly when signalled, or at their timeout.
+ * @note The tick is stepped by hand, each step runs the scheduler until nothing is ready.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static uint32_t test_now;
+static cor_sem_t test_sem = COR_SEM_INIT(1);
+static cor_event_t test_event = COR_EVENT_INIT;
+static uint32_t test_at[6];
+static uint32_t test_got[6];
+static int test_runs[6];
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+// Takes one count, waits at most 30 ms for it
+static void test_take(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    bool ok;
+    COR_BEGIN();
+    test_runs[n] += 1;
+    cor_sem_take_timeout(&test_sem, 30, ok);
+    test_runs[n] += 1;
+    test_at[n] = test_now;
+    test_got[n] = ok;
+    cor_task_exit();
+}
+
+// Waits for 0x3, the mode and timeout come from the task number
+static void test_flags(void *arg)
+{
+    static const uint8_t mode[6] = {0, 0, 0, COR_EVENT_ANY | COR_EVENT_CLEAR, COR_EVENT_ALL, COR_EVENT_ALL};
+    intptr_t n = (intptr_t)arg;
+    uint32_t flags;
+    COR_BEGIN();
+    test_runs[n] += 1;
+    cor_event_wait(&test_event, n == 5 ? 0x4 : 0x3, mode[n], n == 5 ? 25 : COR_WAIT_FOREVER, flags);
+    test_runs[n] += 1;
+    test_at[n] = test_now;
+    test_got[n] = flags;
+    cor_task_exit();
+}
+
+static void test_step(uint32_t to)
+{
+    while (test_now < to)
+    {
+        test_now += 1;
+        cor_run_until_idle();
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(8, test_tick);
+    for (intptr_t n = 0; n < 3; n++)
+    {
+        COR_CHECK(cor_create_task(&h, test_take, (void *)n));
+    }
+    for (intptr_t n = 3; n < 6; n++)
+    {
+        COR_CHECK(cor_create_task(&h, test_flags, (void *)n));
+    }
+    cor_run_until_idle();
+    // The first taker got the count, the others park
+    COR_CHECK(test_runs[0] == 2 && test_at[0] == 0 && test_got[0] == 1);
+
+    test_step(10);
+    cor_sem_give(&test_sem);
+    COR_CHECK(test_sem.count == 0);
+    cor_event_set(&test_event, 0x1);
+    // The ANY waiter cleared what it matched, so ALL is still short of a flag
+    COR_CHECK(test_event.flags == 0);
+    cor_event_set(&test_event, 0x2);
+    cor_run_until_idle();
+    test_step(12);
+    cor_event_set(&test_event, 0x1);
+    cor_run_until_idle();
+    test_step(40);
+
+    COR_CHECK(test_at[1] == 10 && test_got[1] == 1);
+    COR_CHECK(test_at[2] == 30 && test_got[2] == 0);
+    COR_CHECK(test_at[3] == 10 && test_got[3] == 0x1);
+    COR_CHECK(test_at[4] == 12 && test_got[4] == 0x3 && test_event.flags == 0x3);
+    COR_CHECK(test_at[5] == 25 && test_got[5] == 0);
+    // One run to park, one to finish, nothing polled in between
+    for (int n = 1; n < 6; n++)
+    {
+        COR_CHECK(test_runs[n] == 2);
+    }
+    return cor_test_result("sync");
+}
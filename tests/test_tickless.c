@@ -0,0 +1,63 @@
+/**
+ * @file test_tickless.c
+ * @brief With nothing ready, cor_run_for sleeps through the tickless hook exactly until the next deadline.
+ * @note The hook lives in port_test_tickless.c, it advances the fake tick by the time it is asked to sleep.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_SLEEPS 8
+
+uint32_t test_now;
+uint32_t test_slept[TEST_SLEEPS];
+int test_sleeps;
+cor_handle_t test_waiter;
+
+static uint32_t test_woke[3];
+static uint32_t test_notified;
+
+static uint32_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_sleeper(void *arg)
+{
+    COR_BEGIN();
+    cor_sleep(50);
+    test_woke[0] = test_now;
+    cor_sleep(120);
+    test_woke[1] = test_now;
+    cor_sleep(100);
+    test_woke[2] = test_now;
+    cor_task_exit();
+}
+
+static void test_wait(void *arg)
+{
+    static bool ok;
+    COR_BEGIN();
+    cor_notify_wait(COR_WAIT_FOREVER, ok);
+    test_notified = ok ? test_now : 0;
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t sleeper;
+    cor_init(4, test_tick);
+    COR_CHECK(cor_create_task(&sleeper, test_sleeper, NULL));
+    COR_CHECK(cor_create_task(&test_waiter, test_wait, NULL));
+    COR_CHECK(cor_run_for(400));
+
+    // One sleep per deadline, no polling in between
+    COR_CHECK(test_woke[0] == 50 && test_woke[1] == 170 && test_woke[2] == 270);
+    COR_CHECK(test_slept[0] == 50 && test_slept[1] == 120);
+    // The interrupt ends the third sleep early, the rest of the wait is slept again
+    COR_CHECK(test_slept[2] == 100 && test_slept[3] == 95);
+    COR_CHECK(test_notified == 175);
+    // Nothing left to wait for, the last sleep only runs to the end of the slice
+    COR_CHECK(test_sleeps == 5 && test_slept[4] == 130);
+    return cor_test_result("tickless");
+}
@@ -0,0 +1,84 @@
+/**
+ * @file test_timebase.c
+ * @brief Microsecond sleeps on a faster tick source wake on time, across the counter wrap and without drift.
+ * @note The 1 MHz tick is stepped by hand from just below the 32 bit wrap.
+ */
+
+#include "../coroutine.c"
+#include "cor_test.h"
+
+#define TEST_START 0xFFFFFF00u
+#define TEST_LOOPS 10
+
+static uint32_t test_now = TEST_START;
+static uint32_t test_woke[2];
+static uint32_t test_loop[TEST_LOOPS];
+static int test_loops;
+
+static uint32_t test_tick_1ms(void)
+{
+    return 0;
+}
+
+static cor_tick_t test_tick(void)
+{
+    return test_now;
+}
+
+static void test_sleeper(void *arg)
+{
+    COR_BEGIN();
+    cor_sleep_us(250);
+    test_woke[0] = test_now;
+    cor_sleep(2);
+    test_woke[1] = test_now;
+    cor_task_exit();
+}
+
+// Fixed 125 us rate, the late start of each turn does not push the next deadline
+static void test_pacer(void *arg)
+{
+    static cor_tick_t next;
+    COR_BEGIN();
+    next = cor_get_tick();
+    for (test_loops = 0; test_loops < TEST_LOOPS; test_loops++)
+    {
+        next += cor_us_to_ticks(125);
+        cor_sleep_until(next);
+        test_loop[test_loops] = test_now;
+        // Work that eats part of the period
+        test_now += (uint32_t)test_loops * 7;
+    }
+    cor_task_exit();
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    cor_init(4, test_tick_1ms);
+    COR_CHECK(!cor_set_tick_source(NULL, 1000000));
+    COR_CHECK(!cor_set_tick_source(test_tick, 0));
+    COR_CHECK(cor_set_tick_source(test_tick, 1000000));
+    COR_CHECK(cor_us_to_ticks(250) == 250 && cor_ms_to_ticks(3) == 3000);
+    COR_CHECK(cor_get_tick() == TEST_START);
+    COR_CHECK(cor_create_task(&h, test_sleeper, NULL));
+    COR_CHECK(cor_create_task(&h, test_pacer, NULL));
+    cor_run_until_idle();
+    while (test_now != TEST_START + 3000)
+    {
+        test_now += 1;
+        cor_run_until_idle();
+    }
+    COR_CHECK(test_woke[0] == TEST_START + 250 && test_woke[1] == TEST_START + 2250);
+    for (int i = 0; i < TEST_LOOPS; i++)
+    {
+        COR_CHECK(test_loop[i] == TEST_START + (uint32_t)(i + 1) * 125);
+    }
+
+    // A rate that does not divide a millisecond rounds up, a wait is never short
+    cor_deinit();
+    cor_init(4, test_tick_1ms);
+    COR_CHECK(cor_set_tick_source(test_tick, 32768));
+    COR_CHECK(cor_us_to_ticks(1) == 1 && cor_us_to_ticks(31) == 2 && cor_ms_to_ticks(1) == 33);
+    return cor_test_result("timebase");
+}
@@ -0,0 +1,52 @@
+/**
+ * @file test_trace.c
+ * @brief An idle stretch takes one trace record, the ring is not filled by idle passes.
+ */
+
+#define COR_ENABLE_SIM 1
+#define COR_TRACE_SIZE 256
+#include "../coroutine.c"
+#include "cor_test.h"
+
+static unsigned char test_buf[sizeof(cor_trace_header_t) + COR_TRACE_SIZE * sizeof(cor_trace_event_t)];
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+static void test_sleeper(void *arg)
+{
+    (void)arg;
+    COR_BEGIN();
+    for (;;)
+    {
+        cor_sleep(10);
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h;
+    const cor_trace_header_t *header = (const cor_trace_header_t *)test_buf;
+    const cor_trace_event_t *event = (const cor_trace_event_t *)(test_buf + sizeof(cor_trace_header_t));
+    uint32_t idle = 0;
+    cor_init(4, test_tick);
+    cor_sim_start(1000, 1);
+    cor_create_task(&h, test_sleeper, NULL);
+    cor_run_for(120);
+    COR_CHECK(cor_trace_export(test_buf, sizeof(test_buf)) > sizeof(cor_trace_header_t));
+    COR_CHECK(header->dropped == 0);
+    for (uint32_t i = 0; i < header->count; i++)
+    {
+        COR_CHECK(!(event[i].task == 0 && event[i].event == COR_TRACE_RETURN));
+        if (event[i].task == 0 && event[i].event == COR_TRACE_DISPATCH)
+        {
+            idle += 1;
+            COR_CHECK(i == 0 || !(event[i - 1].task == 0 && event[i - 1].event == COR_TRACE_DISPATCH));
+        }
+    }
+    // One idle stretch per sleep of the task
+    COR_CHECK(idle >= 12 && idle <= 14);
+    return cor_test_result("trace");
+}
@@ -0,0 +1,75 @@
+/**
+ * @file test_watchdog.c
+ * @brief A run of a callback longer than the budget of its task is counted and reported to the hook.
+ * @note COR_CYCLES() reads a counter that only the tasks move, the hook lives in port_test_watchdog.c.
+ */
+
+#define COR_ENABLE_WATCHDOG 1
+#define COR_CYCLES() test_cycles
+#include <stdint.h>
+static uint32_t test_cycles;
+#include "../coroutine.c"
+#include "cor_test.h"
+
+cor_handle_t test_hog;
+uint32_t test_spent;
+uint16_t test_seen;
+int test_bites;
+
+static const uint32_t test_costs[] = {5, 50, 20, 21, 5};
+
+static uint32_t test_tick(void)
+{
+    return 0;
+}
+
+// One run per cost, then every notification costs 100
+static void test_worker(void *arg)
+{
+    static unsigned turn;
+    bool ok;
+    COR_BEGIN();
+    for (turn = 0; turn < sizeof(test_costs) / sizeof(test_costs[0]); turn++)
+    {
+        test_cycles += test_costs[turn];
+        cor_yield();
+    }
+    for (;;)
+    {
+        cor_notify_wait(COR_WAIT_FOREVER, ok);
+        test_cycles += ok ? 100 : 0;
+    }
+}
+
+int main(void)
+{
+    cor_handle_t h, gone;
+    cor_init(4, test_tick);
+    COR_CHECK(cor_create_task(&h, test_worker, NULL));
+    // A budget of exactly the run is not an overrun
+    COR_CHECK(cor_set_budget(&h, 20));
+    cor_run_until_idle();
+    COR_CHECK(cor_get_hogs(&h, false) == 2);
+    COR_CHECK(test_bites == 2 && test_hog == h && test_spent == 21 && test_seen == 2);
+
+    // Cleared on read, then a budget of 0 stops watching
+    COR_CHECK(cor_get_hogs(&h, true) == 2 && cor_get_hogs(&h, false) == 0);
+    COR_CHECK(cor_set_budget(&h, 0));
+    cor_notify(&h);
+    COR_CHECK(cor_run_once());
+    COR_CHECK(test_bites == 2 && cor_get_hogs(&h, false) == 0);
+
+    COR_CHECK(cor_set_budget(&h, 99));
+    cor_notify(&h);
+    COR_CHECK(cor_run_once());
+    COR_CHECK(test_bites == 3 && test_spent == 100 && cor_get_hogs(&h, false) == 1);
+
+    // New tasks start unwatched with COR_WATCHDOG_BUDGET left at 0
+    gone = h;
+    COR_CHECK(cor_delete_task(&h));
+    COR_CHECK(!cor_set_budget(&gone, 10) && cor_get_hogs(&gone, false) == 0);
+    COR_CHECK(cor_create_task(&h, test_worker, NULL));
+    cor_run_until_idle();
+    COR_CHECK(test_bites == 3 && cor_get_hogs(&h, false) == 0);
+    return cor_test_result("watchdog");
+}
@@ -0,0 +1,53 @@
+/**
+ * @file cor_footprint.c
+ * @brief Size report of the scheduler for one configuration.
+ * @note Build: cc -O2 [the -D flags of the firmware] -o cor_footprint cor_footprint.c
+ *       Usage:  cor_footprint
+ *       The kernel source is included directly, so the report covers its private state too.
+ *       Build it with the compiler of the target, e.g. for a semihosted run, to get the sizes of that
+ *       ABI; a host build shows the effect of each configuration flag with host pointer sizes.
+ */
+
+#include "../coroutine.c"
+
+#define REPORT(name, bytes) printf("%-24s %8u\n", name, (unsigned)(bytes))
+
+int main(void)
+{
+    printf("COROUTINE_MAX_SIZE=%u COR_PRIO_LEVELS=%u COR_NUM_CORES=%u cor_id_t=%u cor_tick_t=%u\n",
+           (unsigned)COROUTINE_MAX_SIZE, (unsigned)COR_PRIO_LEVELS, (unsigned)COR_NUM_CORES,
+           (unsigned)(8 * sizeof(cor_id_t)), (unsigned)(8 * sizeof(cor_tick_t)));
+    printf("COR_ENABLE_STATS=%u COR_TRACE_SIZE=%u COR_ENABLE_STACKFUL=%u COR_STACK_POOL_SIZE=%u\n",
+           (unsigned)COR_ENABLE_STATS, (unsigned)COR_TRACE_SIZE, (unsigned)COR_ENABLE_STACKFUL,
+           COR_ENABLE_STACKFUL ? (unsigned)COR_STACK_POOL_SIZE : 0u);
+    printf("COR_POOL_SIZE=%u COR_POOL_CLASSES=%u COR_SCHED_POLICY=%s COR_ENABLE_WATCHDOG=%u COR_ENABLE_SIM=%u\n",
+           (unsigned)COR_POOL_SIZE, (unsigned)COR_POOL_CLASSES, COR_SCHED_POLICY == COR_SCHED_EDF ? "EDF" : "PRIO",
+           (unsigned)COR_ENABLE_WATCHDOG, (unsigned)COR_ENABLE_SIM);
+
+    REPORT("Coroutine_t", sizeof(Coroutine_t));
+    REPORT("table (max size)", sizeof(Coroutine_t) * COROUTINE_MAX_SIZE);
+    REPORT("kernel", sizeof(param));
+    REPORT("  hot task arrays", sizeof(param.task));
+    REPORT("  wait state", sizeof(param.wait));
+    REPORT("  periodic state", sizeof(param.job));
+    REPORT("  sleep queue", sizeof(param.sleep));
+    REPORT("  per core", sizeof(cor_core_t));
+    REPORT("  notify bitmap", sizeof(param.notify) + sizeof(param.notifysum));
+#if COR_ENABLE_STACKFUL
+    REPORT("  stack pool", sizeof(param.stack.pool));
+#endif
+#if COR_POOL_SIZE > 0
+    REPORT("  block pools", sizeof(param.pool));
+#endif
+#if COR_TRACE_SIZE > 0
+    REPORT("  trace ring", sizeof(param.trace));
+#endif
+    REPORT("cor_mutex_t", sizeof(cor_mutex_t));
+    REPORT("cor_sem_t", sizeof(cor_sem_t));
+    REPORT("cor_event_t", sizeof(cor_event_t));
+    REPORT("cor_chan_t", sizeof(cor_chan_t));
+    REPORT("cor_spsc_t", sizeof(cor_spsc_t));
+    REPORT("cor_completion_t", sizeof(cor_completion_t));
+    REPORT("cor_child_t", sizeof(cor_child_t));
+    return 0;
+}
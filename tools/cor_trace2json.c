@@ -0,0 +1,156 @@
+/**
+ * @file cor_trace2json.c
+ * @brief Host decoder for the scheduler trace written by cor_trace_export.
+ * @note Build: cc -O2 -o cor_trace2json cor_trace2json.c
+ *       Usage:  cor_trace2json trace.bin > trace.json, then open it in chrome://tracing or ui.perfetto.dev.
+ *       Each core is a thread row, a task shows as a slice from its dispatch to the return of its callback,
+ *       the other scheduler events are instant markers on the row of the core that recorded them.
+ *       The dump must come from a target of the same endianness as the host.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COR_TRACE_MAGIC 0x54524F43u
+#define COR_TRACE_VERSION 1
+#define MAX_CORES 256
+
+/* Layouts of cor_trace_header_t and cor_trace_event_t, kept free of the target headers */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t hz;
+    uint32_t count;
+    uint32_t dropped;
+} trace_header_t;
+
+typedef struct
+{
+    uint32_t time;
+    uint16_t task;
+    uint8_t event;
+    uint8_t core;
+} trace_event_t;
+
+static const char *const event_name[] = {
+    NULL,
+    "dispatch",
+    "return",
+    "yield",
+    "sleep",
+    "suspend",
+    "resume",
+    "block mutex",
+    "block sem",
+    "block event",
+    "block chan",
+    "block notify",
+    "wake",
+    "timeout",
+    "block io",
+    "hog",
+};
+
+static void print_task(char *buf, size_t len, uint16_t task)
+{
+    if (task == 0)
+    {
+        snprintf(buf, len, "idle");
+    }
+    else
+    {
+        snprintf(buf, len, "task %u", (unsigned)task);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in;
+    trace_header_t header;
+    trace_event_t e;
+    uint64_t base = 0;
+    uint32_t last = 0;
+    uint32_t i;
+    int open_slice[MAX_CORES];
+    uint16_t open_task[MAX_CORES];
+    int first = 1;
+    char name[32];
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+        return 2;
+    }
+    in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != COR_TRACE_MAGIC)
+    {
+        fprintf(stderr, "%s: not a coroutine trace\n", argv[1]);
+        return 1;
+    }
+    if (header.version != COR_TRACE_VERSION || header.size != sizeof(trace_event_t) || header.hz == 0)
+    {
+        fprintf(stderr, "%s: unsupported trace version %u\n", argv[1], (unsigned)header.version);
+        return 1;
+    }
+    memset(open_slice, 0, sizeof(open_slice));
+
+    printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%u},\"traceEvents\":[\n", (unsigned)header.dropped);
+    for (i = 0; i < header.count && fread(&e, sizeof(e), 1, in) == 1; i++)
+    {
+        double ts;
+        // Stamps are 32 bit and wrap, events are in order so unwrap them against the previous one
+        if (i > 0 && e.time < last)
+        {
+            base += (uint64_t)1 << 32;
+        }
+        last = e.time;
+        ts = (double)(base + e.time) * 1e6 / header.hz;
+
+        if (e.event == 1)
+        {
+            if (open_slice[e.core])
+            {
+                printf("%s{\"ph\":\"E\",\"pid\":0,\"tid\":%u,\"ts\":%.3f}", first ? "" : ",\n", (unsigned)e.core, ts);
+                first = 0;
+            }
+            print_task(name, sizeof(name), e.task);
+            printf("%s{\"name\":\"%s\",\"ph\":\"B\",\"pid\":0,\"tid\":%u,\"ts\":%.3f}", first ? "" : ",\n", name, (unsigned)e.core, ts);
+            first = 0;
+            open_slice[e.core] = 1;
+            open_task[e.core] = e.task;
+        }
+        else if (e.event == 2)
+        {
+            // The matching dispatch may have been overwritten already
+            if (open_slice[e.core] && open_task[e.core] == e.task)
+            {
+                printf("%s{\"ph\":\"E\",\"pid\":0,\"tid\":%u,\"ts\":%.3f}", first ? "" : ",\n", (unsigned)e.core, ts);
+                first = 0;
+                open_slice[e.core] = 0;
+            }
+        }
+        else if (e.event < sizeof(event_name) / sizeof(event_name[0]))
+        {
+            print_task(name, sizeof(name), e.task);
+            printf("%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"task\":\"%s\"}}",
+                   first ? "" : ",\n", event_name[e.event], (unsigned)e.core, ts, name);
+            first = 0;
+        }
+        else
+        {
+            fprintf(stderr, "event %u: unknown type %u\n", (unsigned)i, (unsigned)e.event);
+        }
+    }
+    printf("\n]}\n");
+    fclose(in);
+    return 0;
+}